@@ -0,0 +1,197 @@
+// checkpoint.h - Binary simulator checkpoints (checkpoint_file / restore_file)
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout:
+//   char[4] "RCKP", uint32 version, then the sections SimulatorBase::saveCheckpoint
+//   writes, in order.
+// Scalars and trivially copyable structs are stored in native byte order. An
+// array is a uint64 count followed by its elements, padded to 8 bytes, so arrays
+// stay aligned in a mapped file and restore is a bounded sequence of memcpys.
+class CheckpointWriter {
+private:
+    std::vector<char> buffer;
+
+    void append(const void* data, size_t bytes) {
+        const char* p = static_cast<const char*>(data);
+        buffer.insert(buffer.end(), p, p + bytes);
+    }
+
+    void pad() {
+        buffer.resize((buffer.size() + 7) & ~static_cast<size_t>(7), 0);
+    }
+
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    CheckpointWriter() {
+        append("RCKP", 4);
+        put<uint32_t>(VERSION);
+    }
+
+    template <class T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint field must be trivially copyable");
+        append(&value, sizeof(T));
+    }
+
+    template <class T>
+    void putVector(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint array must be trivially copyable");
+        pad();
+        put<uint64_t>(values.size());
+        append(values.data(), values.size() * sizeof(T));
+        pad();
+    }
+
+    template <class T>
+    void putDeque(const std::deque<T>& values) {
+        putVector(std::vector<T>(values.begin(), values.end()));
+    }
+
+    // std::queue exposes only its front: serialize a copy
+    template <class T>
+    void putQueue(std::queue<T> values) {
+        std::vector<T> items;
+        items.reserve(values.size());
+        for (; !values.empty(); values.pop()) items.push_back(values.front());
+        putVector(items);
+    }
+
+    const std::vector<char>& bytes() const { return buffer; }
+    
+    void writeFile(const std::string& filename) const {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot write checkpoint: " + filename);
+        }
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (!file) {
+            throw std::runtime_error("Failed writing checkpoint: " + filename);
+        }
+    }
+};
+
+// Reads a checkpoint through a read-only mapping of the file, or from memory
+class CheckpointReader {
+private:
+    std::string filename;
+    const char* data;
+    size_t size;
+    size_t offset;
+    bool mapped;
+
+    const char* take(size_t bytes) {
+        if (offset + bytes > size) {
+            throw std::runtime_error("Truncated checkpoint: " + filename);
+        }
+        const char* p = data + offset;
+        offset += bytes;
+        return p;
+    }
+
+    void align() {
+        offset = (offset + 7) & ~static_cast<size_t>(7);
+    }
+
+    void checkHeader() {
+        if (std::memcmp(take(4), "RCKP", 4) != 0) {
+            throw std::runtime_error("Not a checkpoint file: " + filename);
+        }
+        if (get<uint32_t>() != CheckpointWriter::VERSION) {
+            throw std::runtime_error("Unsupported checkpoint version: " + filename);
+        }
+    }
+
+public:
+    explicit CheckpointReader(const std::string& name)
+        : filename(name), data(nullptr), size(0), offset(0), mapped(true) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open checkpoint: " + filename);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < 8) {
+            close(fd);
+            throw std::runtime_error("Invalid checkpoint: " + filename);
+        }
+        size = static_cast<size_t>(st.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Cannot map checkpoint: " + filename);
+        }
+        data = static_cast<const char*>(mapping);
+        checkHeader();
+    }
+
+    // Reads a buffer produced by CheckpointWriter::bytes(); the buffer must outlive the reader
+    CheckpointReader(const std::vector<char>& buffer, const std::string& name)
+        : filename(name), data(buffer.data()), size(buffer.size()), offset(0), mapped(false) {
+        checkHeader();
+    }
+
+    ~CheckpointReader() {
+        if (mapped && data) munmap(const_cast<char*>(data), size);
+    }
+
+    CheckpointReader(const CheckpointReader&) = delete;
+    CheckpointReader& operator=(const CheckpointReader&) = delete;
+
+    template <class T>
+    T get() {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint field must be trivially copyable");
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <class T>
+    void get(T& value) {
+        value = get<T>();
+    }
+
+    template <class T>
+    void getVector(std::vector<T>& values) {
+        align();
+        uint64_t count = get<uint64_t>();
+        if (count > (size - offset) / (sizeof(T) ? sizeof(T) : 1)) {
+            throw std::runtime_error("Truncated checkpoint: " + filename);
+        }
+        values.resize(count);
+        std::memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+        align();
+    }
+
+    template <class T>
+    void getDeque(std::deque<T>& values) {
+        std::vector<T> items;
+        getVector(items);
+        values.assign(items.begin(), items.end());
+    }
+
+    template <class T>
+    void getQueue(std::queue<T>& values) {
+        std::vector<T> items;
+        getVector(items);
+        values = std::queue<T>(std::deque<T>(items.begin(), items.end()));
+    }
+
+    bool atEnd() const { return offset == size; }
+};
+
+#endif // CHECKPOINT_H
@@ -5,6 +5,11 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <cmath>
+#include <algorithm>
 
 enum class WorkloadType {
     DATAMINING,
@@ -12,6 +17,70 @@ enum class WorkloadType {
     HADOOP
 };
 
+enum class LoadProfileType {
+    CONSTANT,   // load_factor for the whole run
+    PIECEWISE,  // load_schedule steps
+    ON_OFF,     // 2-state MMPP bursts
+    RAMP,       // linear from load_factor to ramp_end_load
+    DIURNAL     // sinusoid around load_factor
+};
+
+// Routing policies (see routing.h)
+enum class RoutingMode {
+    DIRECT,     // Always wait for the direct circuit
+    VLB,        // Always two hops through a random intermediate
+    THRESHOLD,  // Per-packet direct vs. random VLB (wait time and queue_threshold)
+    POWER_OF_D, // THRESHOLD, with the VLB intermediate the best of routing_choices samples
+    ROTORLB     // Per-slot offer/accept indirection (RotorNet paper)
+};
+
+inline RoutingMode parseRoutingMode(const std::string& name) {
+    if (name == "direct") return RoutingMode::DIRECT;
+    if (name == "vlb") return RoutingMode::VLB;
+    if (name == "threshold") return RoutingMode::THRESHOLD;
+    if (name == "pod" || name == "p2c") return RoutingMode::POWER_OF_D;
+    if (name == "rotorlb") return RoutingMode::ROTORLB;
+    throw std::runtime_error("Unknown routing: " + name);
+}
+
+inline const char* routingModeName(RoutingMode mode) {
+    switch (mode) {
+        case RoutingMode::DIRECT: return "direct";
+        case RoutingMode::VLB: return "vlb";
+        case RoutingMode::THRESHOLD: return "threshold";
+        case RoutingMode::POWER_OF_D: return "pod";
+        case RoutingMode::ROTORLB: return "rotorlb";
+    }
+    return "threshold";
+}
+
+// Rotor switch reconfiguration schedule (see topology.h)
+enum class TopologyType {
+    ROTOR,      // All switches reconfigure together at each slot boundary
+    OPERA       // Switch reconfigurations staggered across the slot
+};
+
+// Simulation engine
+enum class SimEngine {
+    PACKET,     // Discrete-event, per packet (simulator.h)
+    FLUID       // Flow-level rates on the circuits (fluid.h)
+};
+
+// Path pinning for the direct vs. two-hop decision
+enum class PathPinning {
+    NONE,       // Decide per packet
+    FLOW,       // Decide once per flow
+    FLOWLET     // Decide again after an idle gap of flowlet_gap_us
+};
+
+// One step of a piecewise-constant load schedule
+struct LoadStep {
+    double start_ms;
+    double load;
+    
+    bool operator==(const LoadStep& other) const { return start_ms == other.start_ms && load == other.load; }
+};
+
 struct SimConfig {
     // Network parameters
     int num_racks = 16;
@@ -21,22 +90,80 @@ struct SimConfig {
     int mtu_bytes = 1500;
     double propagation_delay_us = 0.5;
     int queue_threshold = 4;
+    bool model_hosts = false;   // Rate-limited host NICs and ToR downlinks
+    RoutingMode routing = RoutingMode::THRESHOLD;
+    std::vector<RoutingMode> compare_routing;   // If set, run once per policy and compare
+    bool common_random_numbers = false; // Per-packet routing substreams; compare runs share one flow list
+    int routing_choices = 2;    // Candidates sampled per packet by the pod policy
+    PathPinning path_pinning = PathPinning::NONE;
+    double flowlet_gap_us = 100.0;
+    
+    // Packet-switched network for LOW_LATENCY flows (hybrid RotorNet; 0 disables)
+    double packet_switch_gbps = 0.0;
+    int packet_switch_queue_pkts = 100;
+    uint64_t low_latency_threshold_bytes = 0;   // Generated flows below this size are LOW_LATENCY (0 = none)
+    
+    SimEngine engine = SimEngine::PACKET;
     
     // RotorNet specific
+    TopologyType topology = TopologyType::ROTOR;
+    std::string schedule_file = "";     // If set, load per-switch matchings (CSV or .bin) instead of round-robin
+    int topology_formula_min_racks = 1024;  // Compute round-robin matchings arithmetically from this size (0 = never)
     double reconfig_delay_us = 20.0;
     double duty_cycle = 0.9;
+    int packet_train_max_pkts = 1;      // Back-to-back packets per VOQ sent as one event (1 = per-packet events)
+    uint64_t hybrid_fluid_min_bytes = 0;    // Packet engine: bulk flows this large are fluid VOQ entries (0 = off)
     
     // Workload parameters
     WorkloadType workload = WorkloadType::DATAMINING;
     double load_factor = 0.25; // Network load (0.0 to 1.0)
     double sim_time_ms = 1000.0;
+    double drain_cap_ms = 0.0;  // Stop arrivals at sim_time_ms, then run up to this long for started flows to finish (0 = off)
     int random_seed = 42;
     std::string flow_file = ""; // If set, load flows from file instead of generating
     bool save_flows = false;    // If true, save generated flows to file
     std::string flow_output_file = "flows.csv";
+    int workload_threads = 1;   // 1 = lazy generation; otherwise pre-generate on N threads (0 = all cores)
+    
+    // Time-varying load (see load_profile.h)
+    LoadProfileType load_profile = LoadProfileType::CONSTANT;
+    std::vector<LoadStep> load_schedule;  // "t_ms:load,t_ms:load,..."
+    double onoff_on_load = 0.9;
+    double onoff_off_load = 0.1;
+    double onoff_mean_on_ms = 5.0;
+    double onoff_mean_off_ms = 50.0;
+    double ramp_end_load = 0.9;
+    double diurnal_period_ms = 100.0;
+    double diurnal_amplitude = 0.5;
+    
+    // Time series of VOQ backlog, drops and goodput (0 disables sampling)
+    double sample_interval_ms = 0.0;
+    std::string timeseries_file = "timeseries.csv";
+    
+    // Steady-state detection on the sampled time series (packet engine, see steady_state.h)
+    bool steady_state = false;          // Exclude flows that start during the detected warm-up
+    double steady_ci_target = 0.05;     // Stop once the 95% CI of p99 FCT is within +-this fraction (0 = never)
+    
+    // Checkpoints (packet engine, see checkpoint.h)
+    double checkpoint_time_ms = -1.0;   // Save the full state before the first event after this time (<0 = never)
+    std::string checkpoint_file = "checkpoint.bin";
+    std::string restore_file = "";      // If set, resume from this checkpoint instead of starting at time 0
+    
+    // What-if branching (packet engine): run to branch_time_ms, then fork one child per variant
+    double branch_time_ms = -1.0;       // <0 = off
+    std::vector<std::string> branch_variants;   // "key=value,key=value;key=value;..."
+    
+    // Independent replications: seeds random_seed .. random_seed + replications - 1
+    int replications = 1;               // >1 runs them concurrently and reports 95% CIs
+    int replication_threads = 0;        // Worker threads (0 = all cores)
+    bool quiet = false;                 // Suppress per-run progress output (set for replications)
+    bool stream_fcts = false;           // Keep FCTs only as a quantile sketch, no per-flow records (set for replications)
     
     // Transport parameters
     int queue_size_pkts = 100;
+    bool lossless = false;      // Credit-based backpressure instead of drops on VOQ overflow
+    bool retransmit = false;    // Per-flow reliable transport: resend dropped packets on timeout
+    double rto_us = 0.0;        // Retransmission timeout (0 = 3 cycle times)
     
     void setDefaults() {
         // Already set above
@@ -63,7 +190,21 @@ struct SimConfig {
         if (!file.is_open()) {
             throw std::runtime_error("Cannot open config file: " + filename);
         }
-        
+        loadFromStream(file);
+    }
+    
+    // Copy of this config with a branch variant's "key=value,key=value" overrides applied
+    SimConfig withOverrides(const std::string& spec) const {
+        std::string text = spec;
+        std::replace(text.begin(), text.end(), ',', ' ');
+        std::replace(text.begin(), text.end(), '=', ' ');
+        std::istringstream overrides(text);
+        SimConfig variant = *this;
+        variant.loadFromStream(overrides);
+        return variant;
+    }
+    
+    void loadFromStream(std::istream& file) {
         std::string key;
         while (file >> key) {
             if (key == "num_racks") file >> num_racks;
@@ -72,6 +213,7 @@ struct SimConfig {
             else if (key == "link_rate_gbps") file >> link_rate_gbps;
             else if (key == "load_factor") file >> load_factor;
             else if (key == "sim_time_ms") file >> sim_time_ms;
+            else if (key == "drain_cap_ms") file >> drain_cap_ms;
             else if (key == "random_seed") file >> random_seed;
             else if (key == "workload") {
                 std::string wl;
@@ -87,20 +229,218 @@ struct SimConfig {
                 save_flows = (val == "true" || val == "1");
             }
             else if (key == "queue_threshold") file >> queue_threshold;
+            else if (key == "queue_size_pkts") file >> queue_size_pkts;
+            else if (key == "routing") {
+                std::string r;
+                file >> r;
+                routing = parseRoutingMode(r);
+            }
+            else if (key == "topology") {
+                std::string topo;
+                file >> topo;
+                if (topo == "rotor") topology = TopologyType::ROTOR;
+                else if (topo == "opera") topology = TopologyType::OPERA;
+                else throw std::runtime_error("Unknown topology: " + topo);
+            }
+            else if (key == "engine") {
+                std::string eng;
+                file >> eng;
+                if (eng == "packet") engine = SimEngine::PACKET;
+                else if (eng == "fluid") engine = SimEngine::FLUID;
+                else throw std::runtime_error("Unknown engine: " + eng);
+            }
+            else if (key == "schedule_file") file >> schedule_file;
+            else if (key == "topology_formula_min_racks") file >> topology_formula_min_racks;
+            else if (key == "routing_choices") file >> routing_choices;
+            else if (key == "packet_train_max_pkts") file >> packet_train_max_pkts;
+            else if (key == "hybrid_fluid_min_bytes") file >> hybrid_fluid_min_bytes;
+            else if (key == "path_pinning") {
+                std::string pin;
+                file >> pin;
+                if (pin == "none") path_pinning = PathPinning::NONE;
+                else if (pin == "flow") path_pinning = PathPinning::FLOW;
+                else if (pin == "flowlet") path_pinning = PathPinning::FLOWLET;
+                else throw std::runtime_error("Unknown path_pinning: " + pin);
+            }
+            else if (key == "flowlet_gap_us") file >> flowlet_gap_us;
+            else if (key == "packet_switch_gbps") file >> packet_switch_gbps;
+            else if (key == "packet_switch_queue_pkts") file >> packet_switch_queue_pkts;
+            else if (key == "low_latency_threshold_bytes") file >> low_latency_threshold_bytes;
+            else if (key == "compare_routing") {
+                std::string list;
+                file >> list;
+                compare_routing = parseRoutingList(list);
+            }
+            else if (key == "common_random_numbers") {
+                std::string val;
+                file >> val;
+                common_random_numbers = (val == "true" || val == "1");
+            }
+            else if (key == "retransmit") {
+                std::string val;
+                file >> val;
+                retransmit = (val == "true" || val == "1");
+            }
+            else if (key == "rto_us") file >> rto_us;
+            else if (key == "lossless") {
+                std::string val;
+                file >> val;
+                lossless = (val == "true" || val == "1");
+            }
+            else if (key == "model_hosts") {
+                std::string val;
+                file >> val;
+                model_hosts = (val == "true" || val == "1");
+            }
             else if (key == "flow_output_file") file >> flow_output_file;
+            else if (key == "workload_threads") file >> workload_threads;
+            else if (key == "load_profile") {
+                std::string lp;
+                file >> lp;
+                if (lp == "constant") load_profile = LoadProfileType::CONSTANT;
+                else if (lp == "piecewise") load_profile = LoadProfileType::PIECEWISE;
+                else if (lp == "onoff") load_profile = LoadProfileType::ON_OFF;
+                else if (lp == "ramp") load_profile = LoadProfileType::RAMP;
+                else if (lp == "diurnal") load_profile = LoadProfileType::DIURNAL;
+                else throw std::runtime_error("Unknown load_profile: " + lp);
+            }
+            else if (key == "load_schedule") {
+                std::string sched;
+                file >> sched;
+                load_schedule = parseLoadSchedule(sched);
+            }
+            else if (key == "onoff_on_load") file >> onoff_on_load;
+            else if (key == "onoff_off_load") file >> onoff_off_load;
+            else if (key == "onoff_mean_on_ms") file >> onoff_mean_on_ms;
+            else if (key == "onoff_mean_off_ms") file >> onoff_mean_off_ms;
+            else if (key == "ramp_end_load") file >> ramp_end_load;
+            else if (key == "diurnal_period_ms") file >> diurnal_period_ms;
+            else if (key == "diurnal_amplitude") file >> diurnal_amplitude;
+            else if (key == "sample_interval_ms") file >> sample_interval_ms;
+            else if (key == "timeseries_file") file >> timeseries_file;
+            else if (key == "steady_state") {
+                std::string val;
+                file >> val;
+                steady_state = (val == "true" || val == "1");
+            }
+            else if (key == "steady_ci_target") file >> steady_ci_target;
+            else if (key == "replications") file >> replications;
+            else if (key == "replication_threads") file >> replication_threads;
+            else if (key == "checkpoint_time_ms") file >> checkpoint_time_ms;
+            else if (key == "checkpoint_file") file >> checkpoint_file;
+            else if (key == "restore_file") file >> restore_file;
+            else if (key == "branch_time_ms") file >> branch_time_ms;
+            else if (key == "branch_variants") {
+                std::string list;
+                file >> list;
+                branch_variants = parseBranchVariants(list);
+            }
             else
                 std::cout << "Unknown key in config file: " << key << std::endl;
         }
     }
     
+    // Parse "direct,vlb,..." into routing modes
+    static std::vector<RoutingMode> parseRoutingList(const std::string& text) {
+        std::vector<RoutingMode> modes;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            modes.push_back(parseRoutingMode(item));
+        }
+        return modes;
+    }
+    
+    // Parse "spec;spec;..." (each spec "key=value,key=value") into variant specs
+    static std::vector<std::string> parseBranchVariants(const std::string& text) {
+        std::vector<std::string> specs;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ';')) {
+            if (!item.empty()) specs.push_back(item);
+        }
+        return specs;
+    }
+    
+    // Parse "t_ms:load,t_ms:load,..." into steps sorted by start time
+    static std::vector<LoadStep> parseLoadSchedule(const std::string& text) {
+        std::vector<LoadStep> steps;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            size_t colon = item.find(':');
+            if (colon == std::string::npos) {
+                throw std::runtime_error("Bad load_schedule entry (want t_ms:load): " + item);
+            }
+            steps.push_back({std::stod(item.substr(0, colon)), std::stod(item.substr(colon + 1))});
+        }
+        std::sort(steps.begin(), steps.end(),
+                  [](const LoadStep& a, const LoadStep& b) { return a.start_ms < b.start_ms; });
+        return steps;
+    }
+    
     void print() const {
         std::cout << "Configuration:" << std::endl;
         std::cout << "  Racks: " << num_racks << std::endl;
         std::cout << "  Switches: " << num_switches << std::endl;
         std::cout << "  Hosts per rack: " << hosts_per_rack << std::endl;
         std::cout << "  Link rate: " << link_rate_gbps << " Gb/s" << std::endl;
+        if (model_hosts) {
+            std::cout << "  Host NICs/downlinks: modelled" << std::endl;
+        }
+        if (engine == SimEngine::FLUID) {
+            std::cout << "  Engine: fluid (direct circuits only)" << std::endl;
+        }
+        std::cout << "  Routing: " << routingModeName(routing) << std::endl;
+        if (routing == RoutingMode::POWER_OF_D) {
+            std::cout << "  Routing choices: " << routing_choices << std::endl;
+        }
+        if (path_pinning == PathPinning::FLOW) {
+            std::cout << "  Path pinning: per flow" << std::endl;
+        } else if (path_pinning == PathPinning::FLOWLET) {
+            std::cout << "  Path pinning: per flowlet (gap " << flowlet_gap_us << " us)" << std::endl;
+        }
+        if (common_random_numbers) {
+            std::cout << "  Common random numbers: per-packet routing substreams" << std::endl;
+        }
+        if (hybrid_fluid_min_bytes > 0 && engine == SimEngine::PACKET) {
+            std::cout << "  Hybrid: bulk flows >= " << hybrid_fluid_min_bytes << " bytes as fluid" << std::endl;
+        }
+        if (packet_train_max_pkts > 1) {
+            std::cout << "  Packet trains: up to " << packet_train_max_pkts << " pkts" << std::endl;
+        }
+        if (packet_switch_gbps > 0) {
+            std::cout << "  Packet switch: " << packet_switch_gbps << " Gb/s, "
+                      << packet_switch_queue_pkts << " pkt queues" << std::endl;
+        }
+        if (low_latency_threshold_bytes > 0) {
+            std::cout << "  Low-latency threshold: " << low_latency_threshold_bytes << " bytes" << std::endl;
+        }
         std::cout << "  Load factor: " << load_factor << std::endl;
         std::cout << "  Simulation time: " << sim_time_ms << " ms" << std::endl;
+        if (drain_cap_ms > 0) {
+            std::cout << "  Drain: up to " << drain_cap_ms << " ms after arrivals stop" << std::endl;
+        }
+        if (steady_state) {
+            std::cout << "  Steady state: MSER-5 warm-up trimming";
+            if (steady_ci_target > 0) {
+                std::cout << ", stop at p99 FCT CI +-" << steady_ci_target * 100 << "%";
+            }
+            std::cout << std::endl;
+        }
+        if (replications > 1) {
+            std::cout << "  Replications: " << replications << " (seeds " << random_seed << ".."
+                      << random_seed + replications - 1 << ")" << std::endl;
+        }
+        if (!restore_file.empty()) {
+            std::cout << "  Restore from: " << restore_file << std::endl;
+        }
+        if (checkpoint_time_ms >= 0) {
+            std::cout << "  Checkpoint: " << checkpoint_file << " at " << checkpoint_time_ms << " ms" << std::endl;
+        }
+        if (branch_time_ms >= 0 && !branch_variants.empty()) {
+            std::cout << "  Branching: " << branch_variants.size() << " variants at " << branch_time_ms << " ms" << std::endl;
+        }
         
         std::string wl_name;
         switch(workload) {
@@ -109,6 +449,24 @@ struct SimConfig {
             case WorkloadType::HADOOP: wl_name = "Hadoop"; break;
         }
         std::cout << "  Workload: " << wl_name << std::endl;
+        
+        switch(load_profile) {
+            case LoadProfileType::CONSTANT: break;
+            case LoadProfileType::PIECEWISE:
+                std::cout << "  Load profile: piecewise (" << load_schedule.size() << " steps)" << std::endl;
+                break;
+            case LoadProfileType::ON_OFF:
+                std::cout << "  Load profile: on/off " << onoff_off_load << " -> " << onoff_on_load
+                          << " (mean on " << onoff_mean_on_ms << " ms, off " << onoff_mean_off_ms << " ms)" << std::endl;
+                break;
+            case LoadProfileType::RAMP:
+                std::cout << "  Load profile: ramp " << load_factor << " -> " << ramp_end_load << std::endl;
+                break;
+            case LoadProfileType::DIURNAL:
+                std::cout << "  Load profile: diurnal (period " << diurnal_period_ms
+                          << " ms, amplitude " << diurnal_amplitude << ")" << std::endl;
+                break;
+        }
         std::cout << std::endl;
     }
     
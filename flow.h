@@ -4,6 +4,8 @@
 
 #include <cstdint>
 #include <vector>
+#include <algorithm>
+#include "checkpoint.h"
 
 enum class FlowType {
     BULK,
@@ -13,6 +15,7 @@ enum class FlowType {
 struct Packet {
     uint64_t id;
     uint64_t flow_id;
+    int seq;            // Index of this packet within its flow
     int src_rack;
     int src_host;
     int dst_host;
@@ -38,9 +41,81 @@ struct Packet {
     // - 1: First hop complete (at intermediate or final)
     // - 2: Second hop complete (only for 2-hop paths)
     int hop_count;      // 0=new, 1=after first hop, 2=delivered
+    
+    int tx_switch;      // Rotor switch whose uplink is carrying the packet
+    
+    // Hybrid mode: a fluid entry stands for all unsent bytes of an elephant flow
+    // and is drained from the head of its VOQ in chunks
+    bool fluid;
+    uint64_t fluid_bytes;        // Bytes not yet sent
+    uint64_t fluid_chunk_bytes;  // Bytes of the chunk on the uplink (0 if none)
+};
+
+// Receiver-side resequencing: packets that arrive ahead of a gap wait in the
+// reorder buffer until every lower sequence number has arrived
+struct ReorderBuffer {
+    enum SlotState : uint8_t { MISSING = 0, BUFFERED = 1, SKIPPED = 2 };
+    
+    int next_expected;              // Lowest sequence number not yet released in order
+    int max_seq_seen;               // Highest sequence number received so far
+    int occupancy;                  // Packets held behind a gap
+    std::vector<uint8_t> slots;     // Allocated on first use, freed when the flow is complete
+    
+    ReorderBuffer() : next_expected(0), max_seq_seen(-1), occupancy(0) {}
+    
+    // Record the arrival of seq. Returns its reorder distance: how far the
+    // highest sequence number already received is ahead of it (0 if in order).
+    int receive(int seq, int num_packets) {
+        int distance = seq < max_seq_seen ? max_seq_seen - seq : 0;
+        max_seq_seen = std::max(max_seq_seen, seq);
+        place(seq, num_packets, BUFFERED);
+        return distance;
+    }
+    
+    // Give up on seq (a loss the transport will not repair): it stops
+    // blocking later packets but occupies no buffer space
+    void skip(int seq, int num_packets) {
+        place(seq, num_packets, SKIPPED);
+    }
+    
+    void save(CheckpointWriter& out) const {
+        out.put<int32_t>(next_expected);
+        out.put<int32_t>(max_seq_seen);
+        out.put<int32_t>(occupancy);
+        out.putVector(slots);
+    }
+    
+    void load(CheckpointReader& in) {
+        next_expected = in.get<int32_t>();
+        max_seq_seen = in.get<int32_t>();
+        occupancy = in.get<int32_t>();
+        in.getVector(slots);
+    }
+    
+private:
+    void place(int seq, int num_packets, SlotState state) {
+        if (slots.empty()) slots.resize(num_packets, MISSING);
+        if (seq != next_expected) {
+            slots[seq] = state;
+            if (state == BUFFERED) occupancy++;
+            return;
+        }
+        next_expected++;
+        while (next_expected < num_packets && slots[next_expected] != MISSING) {
+            if (slots[next_expected] == BUFFERED) occupancy--;
+            next_expected++;
+        }
+        if (next_expected == num_packets) {
+            std::vector<uint8_t>().swap(slots);
+        }
+    }
 };
 
 struct Flow {
+    // pinned_path values other than an intermediate rack id
+    static constexpr int PATH_UNPINNED = -2;
+    static constexpr int PATH_DIRECT = -1;
+    
     uint64_t id;
     int src_rack;
     int dst_rack;  // This is the final destination
@@ -51,15 +126,26 @@ struct Flow {
     double completion_time;
     FlowType type;
     
-    std::vector<uint64_t> packet_ids;
     int packets_sent;
     int packets_received;
     bool completed;
     
+    // Reliable transport (retransmit mode)
+    std::vector<uint64_t> lost_packets;  // Holes reported by the receiver, not yet resent
+    double rto_deadline_us;              // Armed retransmission timer, -1 if none
+    int rto_backoff;                     // Exponential backoff exponent
+    
+    // Path pinning (path_pinning flow|flowlet)
+    int pinned_path;                     // PATH_DIRECT, an intermediate rack, or PATH_UNPINNED
+    double last_enqueue_us;              // Last packet entering the source VOQs (flowlet gaps)
+    
+    ReorderBuffer reorder;
+    
     Flow() : id(0), src_rack(0), dst_rack(0), src_host(0), dst_host(0),
              size_bytes(0), start_time(0), completion_time(0),
              type(FlowType::BULK), packets_sent(0), packets_received(0),
-             completed(false) {}
+             completed(false), rto_deadline_us(-1.0), rto_backoff(0),
+             pinned_path(PATH_UNPINNED), last_enqueue_us(0) {}
     
     // Flow completion time accounts for all hops (1 or 2)
     double getFCT() const {
@@ -70,6 +156,56 @@ struct Flow {
     int getNumPackets(int mtu) const {
         return (size_bytes + mtu - 1) / mtu;
     }
+    
+    void save(CheckpointWriter& out) const {
+        out.put(id);
+        out.put<int32_t>(src_rack);
+        out.put<int32_t>(dst_rack);
+        out.put<int32_t>(src_host);
+        out.put<int32_t>(dst_host);
+        out.put(size_bytes);
+        out.put(start_time);
+        out.put(completion_time);
+        out.put(type);
+        out.put<int32_t>(packets_sent);
+        out.put<int32_t>(packets_received);
+        out.put<uint8_t>(completed);
+        out.putVector(lost_packets);
+        out.put(rto_deadline_us);
+        out.put<int32_t>(rto_backoff);
+        out.put<int32_t>(pinned_path);
+        out.put(last_enqueue_us);
+        reorder.save(out);
+    }
+    
+    void load(CheckpointReader& in) {
+        in.get(id);
+        src_rack = in.get<int32_t>();
+        dst_rack = in.get<int32_t>();
+        src_host = in.get<int32_t>();
+        dst_host = in.get<int32_t>();
+        in.get(size_bytes);
+        in.get(start_time);
+        in.get(completion_time);
+        in.get(type);
+        packets_sent = in.get<int32_t>();
+        packets_received = in.get<int32_t>();
+        completed = in.get<uint8_t>();
+        in.getVector(lost_packets);
+        in.get(rto_deadline_us);
+        rto_backoff = in.get<int32_t>();
+        pinned_path = in.get<int32_t>();
+        in.get(last_enqueue_us);
+        reorder.load(in);
+    }
+};
+
+// What the statistics need of a completed flow once the engine has freed it
+struct FlowRecord {
+    uint64_t id;
+    double start_time;
+    double fct;
+    FlowType type;
 };
 
 #endif // FLOW_H
@@ -0,0 +1,217 @@
+// fluid.h - Flow-level (fluid) engine for fast what-if estimates
+#ifndef FLUID_H
+#define FLUID_H
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include "config.h"
+#include "flow.h"
+#include "topology.h"
+#include "workload_generator.h"
+#include "stats.h"
+
+// Flow-level engine (engine fluid). A flow is a byte backlog in the VOQ of its
+// (source, destination) rack pair, drained only by direct circuits: a VOQ with
+// c circuits up is served at c * link_rate_gbps, shared max-min among its flows
+// (equal demands, so equal shares). Rates only change at flow arrivals,
+// completions and circuit up/down times, and those are the only events.
+// Routing, VOQ limits, host NICs and the packet switch are not modelled.
+class FluidSimulator {
+private:
+    // Backlog of one flow in a fluid VOQ
+    struct FluidFlow {
+        uint64_t id;
+        double remaining_bytes;
+    };
+
+    struct FluidVoq {
+        std::vector<FluidFlow> flows;
+        int circuits = 0;   // Direct circuits currently up from src to dst
+    };
+
+    const SimConfig& config;
+    std::unique_ptr<Topology> topology;
+    Statistics stats;
+
+    std::map<uint64_t, Flow> flows;
+    // Only VOQs holding flows, keyed by src * num_racks + dst
+    std::map<int, FluidVoq> voqs;
+
+    // Arrivals: pulled lazily from the generator, or from a start-time sorted list
+    std::unique_ptr<WorkloadGenerator> workload;
+    std::vector<Flow> flow_list;
+    size_t next_listed;
+    Flow next_flow;
+    bool has_next_flow;
+
+    double current_time_us;
+    double bytes_per_us;    // One circuit's rate
+    double delivered_bytes;
+    uint64_t event_count;
+
+    void pullNextFlow() {
+        if (workload) {
+            has_next_flow = workload->nextFlow(next_flow);
+        } else {
+            has_next_flow = next_listed < flow_list.size();
+            if (has_next_flow) next_flow = std::move(flow_list[next_listed++]);
+        }
+    }
+
+    int countCircuits(int src, int dst) const {
+        int circuits = 0;
+        for (int s = 0; s < config.num_switches; s++) {
+            if (topology->getConnectedRack(src, s, current_time_us) == dst) circuits++;
+        }
+        return circuits;
+    }
+
+    // Next time after current_time_us at which any circuit comes up or tears down
+    double getNextCircuitChange() const {
+        double next = topology->getNextCircuitUpTime(current_time_us);
+        for (int s = 0; s < config.num_switches; s++) {
+            next = std::min(next, topology->getCircuitDownTime(s, current_time_us));
+        }
+        return next;
+    }
+
+    // Earliest completion at the current rates: in each VOQ the flow with the
+    // least remaining finishes first, as all its flows drain at the same rate
+    double getNextCompletion() const {
+        double next = std::numeric_limits<double>::infinity();
+        for (const auto& pair : voqs) {
+            const FluidVoq& voq = pair.second;
+            if (voq.circuits == 0) continue;
+            double min_remaining = voq.flows.front().remaining_bytes;
+            for (const FluidFlow& f : voq.flows) {
+                min_remaining = std::min(min_remaining, f.remaining_bytes);
+            }
+            double rate = voq.circuits * bytes_per_us / voq.flows.size();
+            next = std::min(next, current_time_us + min_remaining / rate);
+        }
+        return next;
+    }
+
+    // Drain every served VOQ for dt_us and retire the flows that finished
+    void advance(double dt_us) {
+        for (auto it = voqs.begin(); it != voqs.end();) {
+            FluidVoq& voq = it->second;
+            if (voq.circuits > 0 && dt_us > 0) {
+                double drained = voq.circuits * bytes_per_us / voq.flows.size() * dt_us;
+                for (FluidFlow& f : voq.flows) {
+                    double sent = std::min(drained, f.remaining_bytes);
+                    f.remaining_bytes -= sent;
+                    delivered_bytes += sent;
+                }
+            }
+            auto done = std::remove_if(voq.flows.begin(), voq.flows.end(), [&](const FluidFlow& f) {
+                if (f.remaining_bytes > 1e-3) return false;
+                Flow& flow = flows[f.id];
+                flow.completed = true;
+                flow.packets_received = flow.getNumPackets(config.mtu_bytes);
+                flow.completion_time = (current_time_us + dt_us + config.propagation_delay_us) / 1000.0;
+                return true;
+            });
+            voq.flows.erase(done, voq.flows.end());
+            it = voq.flows.empty() ? voqs.erase(it) : std::next(it);
+        }
+        current_time_us += dt_us;
+    }
+
+    void admitFlow(Flow& flow) {
+        uint64_t id = flow.id;
+        int src = flow.src_rack;
+        int dst = flow.dst_rack;
+        double size = static_cast<double>(flow.size_bytes);
+        flows[id] = std::move(flow);
+
+        auto inserted = voqs.emplace(src * config.num_racks + dst, FluidVoq());
+        FluidVoq& voq = inserted.first->second;
+        if (inserted.second) {
+            voq.circuits = countCircuits(src, dst);
+        }
+        voq.flows.push_back({id, size});
+    }
+
+    void refreshCircuits() {
+        for (auto& pair : voqs) {
+            pair.second.circuits = countCircuits(pair.first / config.num_racks, pair.first % config.num_racks);
+        }
+    }
+
+public:
+    FluidSimulator(const SimConfig& cfg)
+        : config(cfg), topology(Topology::create(cfg)), next_listed(0), has_next_flow(false),
+          current_time_us(0), bytes_per_us(cfg.link_rate_gbps * 1e3 / 8.0),
+          delivered_bytes(0), event_count(0) {}
+
+    void run() {
+        if (!config.quiet) std::cout << "Generating workload..." << std::endl;
+        if (!config.flow_file.empty()) {
+            WorkloadGenerator wg(config);
+            flow_list = wg.loadFlowsFromFile(config.flow_file);
+            std::stable_sort(flow_list.begin(), flow_list.end(),
+                             [](const Flow& a, const Flow& b) { return a.start_time < b.start_time; });
+        } else if (config.workload_threads != 1) {
+            WorkloadGenerator wg(config);
+            flow_list = wg.generateFlows(config.workload_threads);
+            if (config.save_flows) {
+                wg.saveFlowsToFile(flow_list, config.flow_output_file);
+            }
+        } else {
+            workload.reset(new WorkloadGenerator(config));
+            if (config.save_flows) {
+                workload->openFlowLog(config.flow_output_file);
+            }
+        }
+        pullNextFlow();
+        if (config.stream_fcts) {
+            stats.streamFctsToSketch();
+        }
+
+        if (!config.quiet) std::cout << "Running fluid simulation..." << std::endl;
+        double end_time_us = config.sim_time_ms * 1000.0;
+        double next_circuit_change = getNextCircuitChange();
+
+        while (true) {
+            double next_arrival = has_next_flow ? next_flow.start_time * 1000.0
+                                                : std::numeric_limits<double>::infinity();
+            double next_time = std::min({next_arrival, next_circuit_change, getNextCompletion()});
+            if (next_time > end_time_us) {
+                advance(end_time_us - current_time_us);
+                break;
+            }
+            advance(next_time - current_time_us);
+            event_count++;
+
+            while (has_next_flow && next_flow.start_time * 1000.0 <= current_time_us) {
+                admitFlow(next_flow);
+                pullNextFlow();
+            }
+            if (current_time_us >= next_circuit_change) {
+                refreshCircuits();
+                next_circuit_change = getNextCircuitChange();
+            }
+        }
+
+        if (!config.quiet) {
+            std::cout << "Simulation complete (" << event_count << " events). Collecting statistics..." << std::endl;
+        }
+        for (auto& pair : flows) {
+            stats.addFlow(pair.second);
+        }
+        double sim_time_s = config.sim_time_ms / 1000.0;
+        stats.setTotalThroughput(delivered_bytes * 8.0 / (sim_time_s * 1e9));
+        stats.setSimTime(config.sim_time_ms);
+    }
+
+    Statistics getStatistics() const {
+        return stats;
+    }
+};
+
+#endif // FLUID_H
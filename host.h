@@ -0,0 +1,110 @@
+// host.h - Host NIC and ToR downlink models
+#ifndef HOST_H
+#define HOST_H
+
+#include <deque>
+#include <cstdint>
+#include <algorithm>
+#include "checkpoint.h"
+
+// Host NIC uplink (host -> ToR). Holds the flows that still have packets to send
+// and serves them round-robin, one MTU at a time, at link_rate_gbps. Packets are
+// created only when the NIC serializes them, so a queued flow costs no packet state.
+class HostNic {
+private:
+    std::deque<uint64_t> active_flows;
+    std::deque<uint64_t> retx_packets;  // Packets being resent by the transport
+    bool busy;
+    bool paused;    // Lossless backpressure from the ToR
+
+public:
+    HostNic() : busy(false), paused(false) {}
+
+    void addFlow(uint64_t flow_id) {
+        active_flows.push_back(flow_id);
+    }
+
+    bool hasFlows() const {
+        return !active_flows.empty();
+    }
+
+    void addRetransmission(uint64_t packet_id) {
+        retx_packets.push_back(packet_id);
+    }
+
+    bool hasRetransmissions() const {
+        return !retx_packets.empty();
+    }
+
+    uint64_t popRetransmission() {
+        uint64_t packet_id = retx_packets.front();
+        retx_packets.pop_front();
+        return packet_id;
+    }
+
+    // Flow whose packet is sent next
+    uint64_t currentFlow() const {
+        return active_flows.front();
+    }
+
+    // Advance round-robin after sending one packet of currentFlow()
+    void rotate(bool flow_done) {
+        uint64_t flow_id = active_flows.front();
+        active_flows.pop_front();
+        if (!flow_done) {
+            active_flows.push_back(flow_id);
+        }
+    }
+
+    size_t getNumFlows() const {
+        return active_flows.size();
+    }
+
+    bool isBusy() const { return busy; }
+    void setBusy(bool b) { busy = b; }
+    bool isPaused() const { return paused; }
+    void setPaused(bool p) { paused = p; }
+
+    void save(CheckpointWriter& out) const {
+        out.putDeque(active_flows);
+        out.putDeque(retx_packets);
+        out.put<uint8_t>(busy);
+        out.put<uint8_t>(paused);
+    }
+
+    void load(CheckpointReader& in) {
+        in.getDeque(active_flows);
+        in.getDeque(retx_packets);
+        busy = in.get<uint8_t>();
+        paused = in.get<uint8_t>();
+    }
+};
+
+// ToR downlink (ToR -> host). Packets are delivered in arrival order with no loss,
+// so the port is a FIFO server whose departure times follow arithmetically
+// from arrival times; it needs no events of its own.
+class HostDownlink {
+private:
+    double next_free_us;
+
+public:
+    HostDownlink() : next_free_us(0.0) {}
+
+    // Returns the time the packet is fully delivered to the host.
+    // Arrivals must be presented in non-decreasing time order.
+    double serve(double arrival_us, double tx_time_us) {
+        double start = std::max(arrival_us, next_free_us);
+        next_free_us = start + tx_time_us;
+        return next_free_us;
+    }
+
+    // Queueing delay a packet arriving at arrival_us would see
+    double getBacklogUs(double arrival_us) const {
+        return std::max(0.0, next_free_us - arrival_us);
+    }
+
+    void save(CheckpointWriter& out) const { out.put(next_free_us); }
+    void load(CheckpointReader& in) { in.get(next_free_us); }
+};
+
+#endif // HOST_H
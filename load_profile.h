@@ -0,0 +1,110 @@
+// load_profile.h - Time-varying offered load (schedules, on/off bursts, ramps)
+#ifndef LOAD_PROFILE_H
+#define LOAD_PROFILE_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "config.h"
+#include "rng.h"
+
+// Offered load as a function of simulated time. The workload generator draws
+// candidate arrivals at the peak rate and thins them with getLoad(t) / getPeakLoad()
+// (Lewis-Shedler), so every profile is generated lazily, one arrival at a time.
+//
+// getLoad() must be called with non-decreasing times: the ON_OFF profile advances
+// its Markov state process as time moves forward and never looks back.
+// The state process draws from its own RNG stream, so every copy of a profile
+// (one per workload source) sees the same burst trajectory.
+class LoadProfile {
+private:
+    const SimConfig& config;
+
+    // ON_OFF (2-state MMPP) state
+    PhiloxRng rng;
+    bool burst_on;
+    double next_switch_ms;
+
+    void advanceOnOff(double time_ms) {
+        while (time_ms >= next_switch_ms) {
+            burst_on = !burst_on;
+            double mean_ms = burst_on ? config.onoff_mean_on_ms : config.onoff_mean_off_ms;
+            next_switch_ms += rng.exponential(1.0 / mean_ms);
+        }
+    }
+
+public:
+    // ON_OFF starts in the OFF state: the first advance flips burst_on and draws an OFF sojourn
+    LoadProfile(const SimConfig& cfg)
+        : config(cfg), rng(cfg.random_seed, STREAM_LOAD_PROFILE),
+          burst_on(true), next_switch_ms(0.0) {}
+
+    void save(CheckpointWriter& out) const {
+        rng.save(out);
+        out.put<uint8_t>(burst_on);
+        out.put(next_switch_ms);
+    }
+
+    void load(CheckpointReader& in) {
+        rng.load(in);
+        burst_on = in.get<uint8_t>();
+        in.get(next_switch_ms);
+    }
+
+    // Upper bound of getLoad() over the whole run (thinning envelope)
+    double getPeakLoad() const {
+        switch (config.load_profile) {
+            case LoadProfileType::CONSTANT:
+                return config.load_factor;
+            case LoadProfileType::PIECEWISE: {
+                double peak = 0.0;
+                for (const auto& step : config.load_schedule) {
+                    peak = std::max(peak, step.load);
+                }
+                return peak;
+            }
+            case LoadProfileType::ON_OFF:
+                return std::max(config.onoff_on_load, config.onoff_off_load);
+            case LoadProfileType::RAMP:
+                return std::max(config.load_factor, config.ramp_end_load);
+            case LoadProfileType::DIURNAL:
+                return config.load_factor * (1.0 + std::fabs(config.diurnal_amplitude));
+        }
+        return config.load_factor;
+    }
+
+    // Offered load (fraction of host capacity) at time_ms
+    double getLoad(double time_ms) {
+        switch (config.load_profile) {
+            case LoadProfileType::CONSTANT:
+                return config.load_factor;
+
+            case LoadProfileType::PIECEWISE: {
+                // Steps are sorted by start time; load before the first step is 0
+                double load = 0.0;
+                for (const auto& step : config.load_schedule) {
+                    if (step.start_ms > time_ms) break;
+                    load = step.load;
+                }
+                return load;
+            }
+
+            case LoadProfileType::ON_OFF:
+                advanceOnOff(time_ms);
+                return burst_on ? config.onoff_on_load : config.onoff_off_load;
+
+            case LoadProfileType::RAMP: {
+                double frac = std::min(1.0, std::max(0.0, time_ms / config.sim_time_ms));
+                return config.load_factor + frac * (config.ramp_end_load - config.load_factor);
+            }
+
+            case LoadProfileType::DIURNAL: {
+                double phase = 2.0 * M_PI * time_ms / config.diurnal_period_ms;
+                return std::max(0.0, config.load_factor * (1.0 + config.diurnal_amplitude * std::sin(phase)));
+            }
+        }
+        return config.load_factor;
+    }
+};
+
+#endif // LOAD_PROFILE_H
@@ -4,6 +4,24 @@
 #include "simulator.h"
 #include "config.h"
 #include "stats.h"
+#include "replication.h"
+
+// PROFILE builds: print the event profile of every run in this process and save
+// it next to the results (results.csv -> results_profile.csv)
+static void reportProfile(const std::string& saveName) {
+#ifdef PROFILE
+    const EventProfiler& profile = EventProfiler::global();
+    if (profile.getEventCount() == 0) return;
+    std::string base = saveName;
+    if (base.size() > 4 && base.compare(base.size() - 4, 4, ".csv") == 0) {
+        base.erase(base.size() - 4);
+    }
+    profile.print();
+    profile.saveToFile(base + "_profile.csv");
+#else
+    (void)saveName;
+#endif
+}
 
 int main(int argc, char* argv[]) {
     try {
@@ -35,14 +53,66 @@ int main(int argc, char* argv[]) {
         std::cout << "=========================" << std::endl;
         config.print();
         
+        // Side-by-side routing comparison: same workload, one run per policy
+        if (!config.compare_routing.empty()) {
+            std::vector<std::string> names;
+            std::vector<Statistics> runs;
+            // Common random numbers: generate the workload once for all policies
+            std::shared_ptr<const std::vector<Flow>> shared_flows;
+            if (config.common_random_numbers && config.restore_file.empty()) {
+                shared_flows = generateSharedFlows(config);
+            }
+            for (RoutingMode mode : config.compare_routing) {
+                SimConfig variant = config;
+                variant.routing = mode;
+                std::cout << "\n--- Routing: " << routingModeName(mode) << " ---" << std::endl;
+                names.push_back(routingModeName(mode));
+                runs.push_back(runSimulation(variant, shared_flows));
+                runs.back().print();
+            }
+            Statistics::printComparison(names, runs);
+            Statistics::saveComparison(saveName, names, runs);
+            reportProfile(saveName);
+            return 0;
+        }
+        
+        // Independent replications with confidence intervals
+        if (config.replications > 1) {
+            ReplicationRunner runner(config);
+            runner.run();
+            runner.print();
+            runner.saveToFile(saveName);
+            reportProfile(saveName);
+            return 0;
+        }
+        
+        // What-if branches: shared prefix to branch_time_ms, one forked child per variant
+        if (config.branch_time_ms >= 0 && !config.branch_variants.empty()) {
+            std::vector<std::string> names = {"base"};
+            std::vector<SimConfig> variants;
+            for (const std::string& spec : config.branch_variants) {
+                names.push_back(spec);
+                variants.push_back(config.withOverrides(spec));
+            }
+            std::vector<Statistics> runs = runBranches(config, variants);
+            for (size_t i = 0; i < runs.size(); i++) {
+                std::cout << "\n--- Branch: " << names[i] << " ---" << std::endl;
+                runs[i].print();
+            }
+            Statistics::printComparison(names, runs);
+            Statistics::saveComparison(saveName, names, runs);
+            reportProfile(saveName);
+            return 0;
+        }
+
         // Create and run simulator
-        Simulator sim(config);
-        sim.run();
+        Statistics stats = runSimulation(config);
         
         // Print statistics
-        Statistics stats = sim.getStatistics();
         stats.print();
         stats.saveToFile(saveName);
+        stats.saveTimeSeries(config.timeseries_file);
+        reportProfile(saveName);
         
         return 0;
     } catch (const std::exception& e) {
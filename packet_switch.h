@@ -0,0 +1,72 @@
+// packet_switch.h - Packet-switched network for low-latency traffic (hybrid RotorNet)
+#ifndef PACKET_SWITCH_H
+#define PACKET_SWITCH_H
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include "checkpoint.h"
+
+// Drop-tail FIFO output port. Packets leave in arrival order, so departure times
+// follow arithmetically from arrival times; the queue only remembers the departure
+// times of packets still buffered to decide drops.
+class PacketSwitchPort {
+private:
+    std::deque<double> departures;  // Departure times of queued packets, non-decreasing
+    size_t capacity_pkts;
+
+public:
+    PacketSwitchPort(size_t capacity = 0) : capacity_pkts(capacity) {}
+
+    // Offer a packet arriving at arrival_us. Returns false (drop) if the queue is
+    // full; otherwise sets departure_us to the time it is fully serialized.
+    // Arrivals must be presented in non-decreasing time order.
+    bool offer(double arrival_us, double tx_time_us, double& departure_us) {
+        while (!departures.empty() && departures.front() <= arrival_us) {
+            departures.pop_front();
+        }
+        if (departures.size() >= capacity_pkts) {
+            return false;
+        }
+        double start = departures.empty() ? arrival_us : std::max(arrival_us, departures.back());
+        departure_us = start + tx_time_us;
+        departures.push_back(departure_us);
+        return true;
+    }
+
+    size_t getQueueSize() const { return departures.size(); }
+
+    void save(CheckpointWriter& out) const { out.putDeque(departures); }
+    void load(CheckpointReader& in) { in.getDeque(departures); }
+};
+
+// Single output-queued electrical packet switch connecting every ToR: one uplink
+// port per ToR (ToR -> switch) and one downlink port per ToR (switch -> ToR).
+class PacketSwitch {
+private:
+    std::vector<PacketSwitchPort> uplinks;
+    std::vector<PacketSwitchPort> downlinks;
+
+public:
+    PacketSwitch() {}
+
+    PacketSwitch(int num_racks, size_t queue_pkts)
+        : uplinks(num_racks, PacketSwitchPort(queue_pkts)),
+          downlinks(num_racks, PacketSwitchPort(queue_pkts)) {}
+
+    PacketSwitchPort& getUplink(int rack) { return uplinks[rack]; }
+    PacketSwitchPort& getDownlink(int rack) { return downlinks[rack]; }
+
+    // Only the queued departures are saved; port capacities come from the config
+    void save(CheckpointWriter& out) const {
+        for (const auto& port : uplinks) port.save(out);
+        for (const auto& port : downlinks) port.save(out);
+    }
+
+    void load(CheckpointReader& in) {
+        for (auto& port : uplinks) port.load(in);
+        for (auto& port : downlinks) port.load(in);
+    }
+};
+
+#endif // PACKET_SWITCH_H
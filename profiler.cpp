@@ -0,0 +1,37 @@
+// profiler.cpp - Heap allocation counting for PROFILE builds (see profiler.h)
+//
+// The replacement operators live in their own translation unit: if their
+// bodies were visible where the standard containers allocate, the compiler
+// would inline malloc/free into those call sites and flag every new/delete
+// pair as mismatched.
+#ifdef PROFILE
+#include <new>
+#include <cstdlib>
+#include "profiler.h"
+
+void* operator new(std::size_t size) {
+    threadAllocations()++;
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    threadAllocations()++;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return ::operator new(size, std::nothrow);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+#endif
@@ -0,0 +1,184 @@
+// profiler.h - Per-event-type hot-path profiler (PROFILE builds: make profile)
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Timestamp counter (rdtsc); steady_clock nanoseconds on other architectures
+inline uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Heap allocations made by the calling thread. PROFILE builds replace the global
+// operator new (profiler.cpp) to count them; otherwise this stays 0.
+inline uint64_t& threadAllocations() {
+    thread_local uint64_t count = 0;
+    return count;
+}
+
+// Counts, cycles and heap allocations of each event handler, plus event-queue
+// pushes, pops and depth. Each simulator keeps its own profile and merges it into
+// global() when it finishes, so replications on several threads add up; the
+// children of runBranches exit without reporting theirs. Cycles are inclusive:
+// a handler's cycles contain the pushes it makes.
+class EventProfiler {
+private:
+    struct Row {
+        uint64_t count = 0;
+        uint64_t cycles = 0;
+        uint64_t allocations = 0;
+    };
+    static constexpr uint64_t DEPTH_SAMPLE_EVENTS = 1024;   // Queue depth is averaged over every Nth event
+
+    std::vector<std::string> names;
+    std::vector<Row> handlers;      // Indexed by event type
+    Row pushes;
+    Row pops;
+    uint64_t events;
+    uint64_t depth_samples;
+    uint64_t depth_sum;
+    uint64_t depth_max;
+    double wall_s;
+    std::chrono::steady_clock::time_point run_start;
+
+    uint64_t event_start_cycles;
+    uint64_t event_start_allocations;
+
+    static std::string fixed(double value, int precision) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(precision) << value;
+        return out.str();
+    }
+
+public:
+    explicit EventProfiler(std::vector<std::string> type_names = {})
+        : names(std::move(type_names)), handlers(names.size()), events(0), depth_samples(0), depth_sum(0),
+          depth_max(0), wall_s(0), event_start_cycles(0), event_start_allocations(0) {}
+
+    static EventProfiler& global() {
+        static EventProfiler instance;
+        return instance;
+    }
+
+    void startClock() { run_start = std::chrono::steady_clock::now(); }
+    void stopClock() {
+        wall_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    }
+
+    void beginEvent(size_t queue_depth) {
+        depth_max = std::max<uint64_t>(depth_max, queue_depth);
+        if (events % DEPTH_SAMPLE_EVENTS == 0) {
+            depth_samples++;
+            depth_sum += queue_depth;
+        }
+        event_start_allocations = threadAllocations();
+        event_start_cycles = readCycles();
+    }
+
+    void endEvent(size_t type) {
+        Row& row = handlers[type];
+        row.cycles += readCycles() - event_start_cycles;
+        row.allocations += threadAllocations() - event_start_allocations;
+        row.count++;
+        events++;
+    }
+
+    void addPush(uint64_t cycles) { pushes.count++; pushes.cycles += cycles; }
+    void addPop(uint64_t cycles) { pops.count++; pops.cycles += cycles; }
+
+    uint64_t getEventCount() const { return events; }
+
+    void merge(const EventProfiler& other) {
+        static std::mutex merge_mutex;
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        if (names.empty()) {
+            names = other.names;
+            handlers.assign(names.size(), Row());
+        }
+        for (size_t i = 0; i < handlers.size() && i < other.handlers.size(); i++) {
+            handlers[i].count += other.handlers[i].count;
+            handlers[i].cycles += other.handlers[i].cycles;
+            handlers[i].allocations += other.handlers[i].allocations;
+        }
+        pushes.count += other.pushes.count;
+        pushes.cycles += other.pushes.cycles;
+        pops.count += other.pops.count;
+        pops.cycles += other.pops.cycles;
+        events += other.events;
+        depth_samples += other.depth_samples;
+        depth_sum += other.depth_sum;
+        depth_max = std::max(depth_max, other.depth_max);
+        wall_s += other.wall_s;
+    }
+
+    void print() const {
+        uint64_t total_cycles = 0;
+        for (const Row& row : handlers) total_cycles += row.cycles;
+
+        std::cout << "\n========== Event Profile ==========" << std::endl;
+        std::cout << "  Events: " << events << " in " << fixed(wall_s, 3) << " s ("
+                  << fixed(wall_s > 0 ? events / wall_s / 1e6 : 0.0, 3) << " M events/s)" << std::endl;
+        std::cout << "  Queue depth: mean " << fixed(depth_samples ? double(depth_sum) / depth_samples : 0.0, 1)
+                  << ", max " << depth_max << std::endl;
+        std::cout << std::left << std::setw(30) << "handler" << std::right << std::setw(12) << "count"
+                  << std::setw(12) << "cycles/evt" << std::setw(10) << "cycles%"
+                  << std::setw(12) << "allocs/evt" << std::endl;
+        for (size_t i = 0; i < handlers.size(); i++) {
+            const Row& row = handlers[i];
+            if (row.count == 0) continue;
+            std::cout << std::left << std::setw(30) << names[i] << std::right << std::setw(12) << row.count
+                      << std::setw(12) << fixed(double(row.cycles) / row.count, 0)
+                      << std::setw(10) << fixed(total_cycles ? 100.0 * row.cycles / total_cycles : 0.0, 1)
+                      << std::setw(12) << fixed(double(row.allocations) / row.count, 2) << std::endl;
+        }
+        for (const auto& op : {std::make_pair("(queue push)", &pushes), std::make_pair("(queue pop)", &pops)}) {
+            if (op.second->count == 0) continue;
+            std::cout << std::left << std::setw(30) << op.first << std::right << std::setw(12) << op.second->count
+                      << std::setw(12) << fixed(double(op.second->cycles) / op.second->count, 0)
+                      << std::setw(10) << fixed(total_cycles ? 100.0 * op.second->cycles / total_cycles : 0.0, 1)
+                      << std::setw(12) << "" << std::endl;
+        }
+        std::cout << "===================================" << std::endl;
+    }
+
+    void saveToFile(const std::string& filename) const {
+        std::ofstream file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Warning: Could not open " << filename << " for writing" << std::endl;
+            return;
+        }
+
+        file << "handler,count,cycles,allocations\n";
+        for (size_t i = 0; i < handlers.size(); i++) {
+            file << names[i] << "," << handlers[i].count << "," << handlers[i].cycles << ","
+                 << handlers[i].allocations << "\n";
+        }
+        file << "queue_push," << pushes.count << "," << pushes.cycles << ",\n";
+        file << "queue_pop," << pops.count << "," << pops.cycles << ",\n";
+        file << "wall_s," << wall_s << ",,\n";
+        file << "queue_depth_mean," << (depth_samples ? double(depth_sum) / depth_samples : 0.0) << ",,\n";
+        file << "queue_depth_max," << depth_max << ",,\n";
+
+        file.close();
+        std::cout << "Profile saved to " << filename << std::endl;
+    }
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,68 @@
+// quantile_sketch.h - Mergeable relative-error quantile sketch (FCT percentiles across runs)
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <map>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// Log-bucketed histogram in the style of DDSketch: a value v > 0 is counted in
+// bucket ceil(log_gamma(v)), gamma = (1 + a) / (1 - a), so every quantile it
+// returns is within a factor (1 +- a) of the exact one. Memory grows with the
+// dynamic range of the values (a few hundred buckets for microseconds to
+// seconds at 1%), not with their count, and two sketches of the same accuracy
+// merge exactly by adding bucket counts.
+class QuantileSketch {
+private:
+    static constexpr double MIN_VALUE = 1e-9;   // Smaller values share the zero bucket
+
+    double gamma;
+    double log_gamma;
+    std::map<int, uint64_t> buckets;
+    uint64_t zero_count;
+    uint64_t count;
+
+public:
+    explicit QuantileSketch(double accuracy = 0.01)
+        : gamma((1.0 + accuracy) / (1.0 - accuracy)), log_gamma(std::log(gamma)),
+          zero_count(0), count(0) {}
+
+    void add(double value) {
+        count++;
+        if (value <= MIN_VALUE) {
+            zero_count++;
+            return;
+        }
+        buckets[static_cast<int>(std::ceil(std::log(value) / log_gamma))]++;
+    }
+
+    void merge(const QuantileSketch& other) {
+        for (const auto& pair : other.buckets) {
+            buckets[pair.first] += pair.second;
+        }
+        zero_count += other.zero_count;
+        count += other.count;
+    }
+
+    uint64_t getCount() const { return count; }
+
+    // Value of rank floor(q * count), like Statistics::getPercentile; 0 if empty
+    double quantile(double q) const {
+        if (count == 0) return 0.0;
+        uint64_t rank = std::min(static_cast<uint64_t>(q * count), count - 1);
+        if (rank < zero_count) return 0.0;
+
+        uint64_t seen = zero_count;
+        for (const auto& pair : buckets) {
+            seen += pair.second;
+            if (seen > rank) {
+                // Midpoint (in relative error) of (gamma^(k-1), gamma^k]
+                return 2.0 * std::pow(gamma, pair.first) / (gamma + 1.0);
+            }
+        }
+        return 2.0 * std::pow(gamma, buckets.rbegin()->first) / (gamma + 1.0);
+    }
+};
+
+#endif // QUANTILE_SKETCH_H
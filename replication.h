@@ -0,0 +1,210 @@
+// replication.h - Independent replications on a thread pool, with confidence intervals
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include "config.h"
+#include "simulator.h"
+#include "quantile_sketch.h"
+
+// Runs `replications` copies of a config, replication i with random_seed + i, so
+// each has its own workload and simulator Philox streams. Worker threads pull
+// replications from a shared counter and keep only a small summary and an FCT
+// sketch of each. A replication frees its flows and packets as they finish and
+// streams their FCTs into the sketch, so memory is the in-flight state of one
+// simulation per thread (plus a record per completed flow with steady_state,
+// whose warm-up cut is only known at the end). Metrics are
+// reported as the mean over replications with a Student-t 95% confidence
+// interval; the sketches merge into pooled FCT percentiles.
+class ReplicationRunner {
+private:
+    struct Result {
+        double completed_pct;
+        double throughput_gbps;
+        double mean_fct_ms;
+        double p50_fct_ms;
+        double p99_fct_ms;
+        QuantileSketch fcts;
+    };
+
+    struct Interval {
+        double mean;
+        double half_width;
+        double min;
+        double max;
+    };
+
+    const SimConfig& config;
+    std::vector<Result> results;    // Indexed by replication (seed offset)
+    QuantileSketch pooled;
+
+    // Two-sided 95% Student-t quantile for dof degrees of freedom
+    static double tQuantile(int dof) {
+        static const double table[] = {
+            12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+            2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+            2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+        };
+        if (dof < 1) return 0.0;
+        return dof <= 30 ? table[dof - 1] : 1.96;
+    }
+
+    static std::vector<std::pair<std::string, double Result::*>> getMetrics() {
+        return {
+            {"completed_pct", &Result::completed_pct},
+            {"throughput_gbps", &Result::throughput_gbps},
+            {"mean_fct_ms", &Result::mean_fct_ms},
+            {"p50_fct_ms", &Result::p50_fct_ms},
+            {"p99_fct_ms", &Result::p99_fct_ms}
+        };
+    }
+
+    Interval summarize(double Result::*metric) const {
+        Interval iv = {0.0, 0.0, results[0].*metric, results[0].*metric};
+        for (const Result& r : results) {
+            iv.mean += r.*metric;
+            iv.min = std::min(iv.min, r.*metric);
+            iv.max = std::max(iv.max, r.*metric);
+        }
+        size_t n = results.size();
+        iv.mean /= n;
+        if (n > 1) {
+            double sum_sq = 0.0;
+            for (const Result& r : results) {
+                sum_sq += (r.*metric - iv.mean) * (r.*metric - iv.mean);
+            }
+            iv.half_width = tQuantile(static_cast<int>(n - 1)) * std::sqrt(sum_sq / (n - 1) / n);
+        }
+        return iv;
+    }
+
+    void runOne(int index) {
+        SimConfig replica = config;
+        replica.random_seed = config.random_seed + index;
+        replica.quiet = true;
+        replica.workload_threads = 1;       // Lazy arrivals: only pending flows are held
+        replica.stream_fcts = true;
+        replica.save_flows = false;
+        replica.checkpoint_time_ms = -1.0;
+
+        Statistics stats = runSimulation(replica);
+        Result& r = results[index];
+        r.completed_pct = stats.getTotalFlows() ? 100.0 * stats.getCompletedFlows() / stats.getTotalFlows() : 0.0;
+        r.throughput_gbps = stats.getThroughputGbps();
+        r.mean_fct_ms = stats.getMeanFct();
+        r.p50_fct_ms = stats.getFctPercentile(0.5);
+        r.p99_fct_ms = stats.getFctPercentile(0.99);
+        r.fcts = stats.getFctSketch();
+    }
+
+public:
+    ReplicationRunner(const SimConfig& cfg) : config(cfg) {}
+
+    void run() {
+        int count = config.replications;
+        int num_threads = config.replication_threads;
+        if (num_threads <= 0) {
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        num_threads = std::min(num_threads, count);
+
+        // Each replication has its own seed, so there is no second run to pair with
+        if (config.common_random_numbers) {
+            throw std::runtime_error("common_random_numbers pairs the runs of compare_routing "
+                                     "or branches; it cannot be combined with replications");
+        }
+        if (!config.flow_file.empty()) {
+            std::cerr << "Warning: flow_file is shared by all replications; "
+                      << "they differ only in the simulator's random choices" << std::endl;
+        }
+        std::cout << "Running " << count << " replications (seeds " << config.random_seed << ".."
+                  << config.random_seed + count - 1 << ") on " << num_threads << " threads..." << std::endl;
+
+        results.assign(count, Result());
+        std::atomic<int> next(0);
+        std::atomic<int> done(0);
+        std::mutex error_mutex;
+        std::exception_ptr error;
+
+        auto worker = [&]() {
+            for (int i = next++; i < count; i = next++) {
+                try {
+                    runOne(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) error = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(error_mutex);
+                std::cout << "  Replication " << i << " done (" << ++done << "/" << count << ")" << std::endl;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int t = 1; t < num_threads; t++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& th : threads) {
+            th.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        for (const Result& r : results) {
+            pooled.merge(r.fcts);
+        }
+    }
+
+    void print() const {
+        std::cout << "\n========== Replications (" << results.size() << " seeds, 95% CI) ==========" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << std::left << std::setw(16) << "metric" << std::right
+                  << std::setw(12) << "mean" << std::setw(12) << "+-ci"
+                  << std::setw(12) << "min" << std::setw(12) << "max" << std::endl;
+        for (const auto& m : getMetrics()) {
+            Interval iv = summarize(m.second);
+            std::cout << std::left << std::setw(16) << m.first << std::right
+                      << std::setw(12) << iv.mean << std::setw(12) << iv.half_width
+                      << std::setw(12) << iv.min << std::setw(12) << iv.max << std::endl;
+        }
+        std::cout << "\nPooled FCTs (" << pooled.getCount() << " flows, sketch within 1%):" << std::endl;
+        std::cout << "  Median: " << pooled.quantile(0.5) << " ms" << std::endl;
+        std::cout << "  99th: " << pooled.quantile(0.99) << " ms" << std::endl;
+        std::cout << "  99.9th: " << pooled.quantile(0.999) << " ms" << std::endl;
+        std::cout << "================================================" << std::endl;
+    }
+
+    void saveToFile(const std::string& filename) const {
+        std::ofstream file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Warning: Could not open " << filename << " for writing" << std::endl;
+            return;
+        }
+
+        file << "metric,mean,ci95_half_width,min,max\n";
+        for (const auto& m : getMetrics()) {
+            Interval iv = summarize(m.second);
+            file << m.first << "," << iv.mean << "," << iv.half_width << "," << iv.min << "," << iv.max << "\n";
+        }
+        file << "pooled_p50_fct_ms," << pooled.quantile(0.5) << ",,,\n";
+        file << "pooled_p99_fct_ms," << pooled.quantile(0.99) << ",,,\n";
+        file << "pooled_p999_fct_ms," << pooled.quantile(0.999) << ",,,\n";
+
+        file.close();
+        std::cout << "Replication summary saved to " << filename << std::endl;
+    }
+};
+
+#endif // REPLICATION_H
@@ -0,0 +1,135 @@
+// rng.h - Counter-based random number generation (Philox4x32-10)
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include "checkpoint.h"
+
+// Well-known stream ids. Workload sources use their source rack id as the stream,
+// so these live far above any rack id.
+enum RngStream : uint64_t {
+    STREAM_LOAD_PROFILE = 0xFFFF0000ULL,
+    STREAM_SIMULATOR    = 0xFFFF0001ULL,
+    STREAM_FLOW_DECISIONS = 0x100000000ULL  // + flow id: per-flow routing draws (common_random_numbers)
+};
+
+// Philox4x32-10 (Salmon et al., SC'11). The output is a pure function of
+// (key, counter): key = seed, counter = (block index, stream id). Streams with
+// different ids never overlap, and any stream can be created anywhere (any thread,
+// any order) with the same results. Satisfies UniformRandomBitGenerator, so it can
+// also drive the <random> distributions.
+class PhiloxRng {
+private:
+    static constexpr uint32_t M0 = 0xD2511F53;
+    static constexpr uint32_t M1 = 0xCD9E8D57;
+    static constexpr uint32_t W0 = 0x9E3779B9;
+    static constexpr uint32_t W1 = 0xBB67AE85;
+
+    uint32_t key[2];
+    uint32_t counter[4];  // counter[0..1] = block index, counter[2..3] = stream id
+    uint32_t output[4];
+    int output_idx;       // next unused word of output (4 = empty)
+
+    static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+        uint64_t product = static_cast<uint64_t>(a) * b;
+        hi = static_cast<uint32_t>(product >> 32);
+        lo = static_cast<uint32_t>(product);
+    }
+
+public:
+    using result_type = uint32_t;
+
+    PhiloxRng(uint64_t seed = 0, uint64_t stream = 0) {
+        key[0] = static_cast<uint32_t>(seed);
+        key[1] = static_cast<uint32_t>(seed >> 32);
+        counter[0] = 0;
+        counter[1] = 0;
+        counter[2] = static_cast<uint32_t>(stream);
+        counter[3] = static_cast<uint32_t>(stream >> 32);
+        output_idx = 4;
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<uint32_t>::max(); }
+
+    // One Philox4x32-10 block: 4 words from (key, ctr)
+    static void block(const uint32_t in_key[2], const uint32_t ctr[4], uint32_t out[4]) {
+        uint32_t k0 = in_key[0], k1 = in_key[1];
+        uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+        for (int round = 0; round < 10; round++) {
+            uint32_t hi0, lo0, hi1, lo1;
+            mulhilo(M0, c0, hi0, lo0);
+            mulhilo(M1, c2, hi1, lo1);
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+            k0 += W0;
+            k1 += W1;
+        }
+        out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+    }
+
+    result_type operator()() {
+        if (output_idx == 4) {
+            block(key, counter, output);
+            if (++counter[0] == 0) ++counter[1];
+            output_idx = 0;
+        }
+        return output[output_idx++];
+    }
+
+    // Jump to the start of block `index` within this stream (random access)
+    void seek(uint64_t index) {
+        counter[0] = static_cast<uint32_t>(index);
+        counter[1] = static_cast<uint32_t>(index >> 32);
+        output_idx = 4;
+    }
+
+    uint64_t nextU64() {
+        uint64_t hi = (*this)();
+        return (hi << 32) | (*this)();
+    }
+
+    // Uniform double in [0, 1) with 53 random bits
+    double nextDouble() {
+        return (nextU64() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Uniform integer in [0, n) (Lemire's multiply-shift with rejection)
+    uint32_t uniformInt(uint32_t n) {
+        uint64_t m = static_cast<uint64_t>((*this)()) * n;
+        uint32_t low = static_cast<uint32_t>(m);
+        if (low < n) {
+            uint32_t threshold = (0u - n) % n;
+            while (low < threshold) {
+                m = static_cast<uint64_t>((*this)()) * n;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+        return static_cast<uint32_t>(m >> 32);
+    }
+
+    // Exponential variate with the given rate
+    double exponential(double rate) {
+        return -std::log1p(-nextDouble()) / rate;
+    }
+
+    void save(CheckpointWriter& out) const {
+        for (uint32_t k : key) out.put(k);
+        for (uint32_t c : counter) out.put(c);
+        for (uint32_t o : output) out.put(o);
+        out.put<int32_t>(output_idx);
+    }
+
+    void load(CheckpointReader& in) {
+        for (uint32_t& k : key) in.get(k);
+        for (uint32_t& c : counter) in.get(c);
+        for (uint32_t& o : output) in.get(o);
+        output_idx = in.get<int32_t>();
+    }
+};
+
+#endif // RNG_H
@@ -0,0 +1,192 @@
+// routing.h - Compile-time routing policies for direct vs. two-hop decisions
+#ifndef ROUTING_H
+#define ROUTING_H
+
+#include <algorithm>
+#include "config.h"
+#include "flow.h"
+#include "rng.h"
+#include "topology.h"
+
+// A routing policy is constructed from the SimConfig and provides:
+//
+//   static constexpr const char* name;
+//   static constexpr bool kPerSlotIndirection;
+//       true if indirection is granted per slot (RotorLB) instead of per packet
+//   template <class Sim> bool useDirect(const Sim& sim, const Packet& pkt, int rack);
+//       first-hop decision for a packet entering the source VOQs
+//   template <class Sim> int selectIntermediate(const Sim& sim, PhiloxRng& rng, int src, int dst);
+//       intermediate rack for a two-hop packet, drawing candidates from rng
+//
+// Sim is the simulator engine (SimulatorBase accessors). Policies are template
+// parameters of Simulator<>, so these calls inline into the packet path.
+
+// Uniform random rack other than src and dst (rejection sampling)
+template <class Sim>
+inline int randomIntermediateRack(const Sim& sim, PhiloxRng& rng, int src, int dst) {
+    int num_racks = sim.getConfig().num_racks;
+    int intermediate;
+    do {
+        intermediate = static_cast<int>(rng.uniformInt(num_racks));
+    } while (intermediate == src || intermediate == dst);
+    return intermediate;
+}
+
+// Always wait for the direct circuit (pure one-hop RotorNet)
+struct DirectRouting {
+    static constexpr const char* name = "direct";
+    static constexpr bool kPerSlotIndirection = false;
+
+    explicit DirectRouting(const SimConfig&) {}
+
+    template <class Sim>
+    bool useDirect(const Sim&, const Packet&, int) const { return true; }
+
+    template <class Sim>
+    int selectIntermediate(const Sim& sim, PhiloxRng& rng, int src, int dst) const {
+        return randomIntermediateRack(sim, rng, src, dst);
+    }
+};
+
+// Always two hops through a uniformly random intermediate (classic VLB)
+struct VlbRouting {
+    static constexpr const char* name = "vlb";
+    static constexpr bool kPerSlotIndirection = false;
+
+    explicit VlbRouting(const SimConfig&) {}
+
+    template <class Sim>
+    bool useDirect(const Sim&, const Packet&, int) const { return false; }
+
+    template <class Sim>
+    int selectIntermediate(const Sim& sim, PhiloxRng& rng, int src, int dst) const {
+        return randomIntermediateRack(sim, rng, src, dst);
+    }
+};
+
+// Direct if the circuit comes up within a slot or the direct VOQ is short,
+// otherwise VLB through a random intermediate
+struct ThresholdRouting {
+    static constexpr const char* name = "threshold";
+    static constexpr bool kPerSlotIndirection = false;
+
+    size_t direct_threshold;
+
+    explicit ThresholdRouting(const SimConfig& cfg) : direct_threshold(cfg.queue_threshold) {}
+
+    /// Gets whether this packet at current rack should try direct connection
+    /// based on Rotor Principle of if waitTime < slotTime. Defaults to true.
+    /// returns false if localQueueSize > queue_threshold
+    template <class Sim>
+    bool useDirect(const Sim& sim, const Packet& pkt, int current_rack) const {
+        double now = sim.getCurrentTime();
+        double direct_wait = sim.getTopology().getNextDirectPathTime(
+            current_rack, pkt.final_dst, now) - now;
+
+        // If direct path available very soon (< slot time), use it
+        if (direct_wait < sim.getTopology().getSlotTime()) {
+            return true;
+        }
+
+        // Check if direct queue is heavily loaded
+        size_t direct_queue = sim.getVoqs(current_rack).getLocalQueueSize(pkt.final_dst);
+        if (direct_queue > direct_threshold) {
+            return false; // Too congested, try VLB
+        }
+
+        return true; // Default to direct
+    }
+
+    template <class Sim>
+    int selectIntermediate(const Sim& sim, PhiloxRng& rng, int src, int dst) const {
+        return randomIntermediateRack(sim, rng, src, dst);
+    }
+};
+
+// Threshold's direct test; VLB samples d intermediates (power-of-d choices) and
+// keeps the one with the earliest expected delivery: wait for src->candidate and
+// then candidate->dst circuits, plus one cycle for every slot's worth of packets
+// already in the candidate's nonlocal VOQ to dst. O(d) with no allocation:
+// each circuit wait only visits the matchings that pair the two racks.
+struct PowerOfDRouting {
+    static constexpr const char* name = "pod";
+    static constexpr bool kPerSlotIndirection = false;
+
+    ThresholdRouting threshold;
+    int choices;
+    size_t slot_capacity_pkts;  // Packets one circuit carries per slot
+
+    explicit PowerOfDRouting(const SimConfig& cfg)
+        : threshold(cfg), choices(std::max(1, cfg.routing_choices)) {
+        double up_time_us = cfg.getSlotTime() - cfg.reconfig_delay_us;
+        double tx_time_us = cfg.mtu_bytes * 8.0 / (cfg.link_rate_gbps * 1e3);
+        slot_capacity_pkts = std::max<size_t>(1, static_cast<size_t>(up_time_us / tx_time_us));
+    }
+
+    template <class Sim>
+    bool useDirect(const Sim& sim, const Packet& pkt, int current_rack) const {
+        return threshold.useDirect(sim, pkt, current_rack);
+    }
+
+    template <class Sim>
+    double deliveryCost(const Sim& sim, int src, int candidate, int dst) const {
+        const Topology& topo = sim.getTopology();
+        double now = sim.getCurrentTime();
+        double first_hop = topo.getNextDirectPathTime(src, candidate, now);
+        double second_hop = topo.getNextDirectPathTime(candidate, dst, first_hop);
+        size_t backlog_cycles = sim.getVoqs(candidate).getNonlocalQueueSize(dst) / slot_capacity_pkts;
+        return (second_hop - now) + backlog_cycles * topo.getCycleTime();
+    }
+
+    template <class Sim>
+    int selectIntermediate(const Sim& sim, PhiloxRng& rng, int src, int dst) const {
+        int best = randomIntermediateRack(sim, rng, src, dst);
+        double best_cost = deliveryCost(sim, src, best, dst);
+        for (int i = 1; i < choices; i++) {
+            int candidate = randomIntermediateRack(sim, rng, src, dst);
+            double cost = deliveryCost(sim, src, candidate, dst);
+            if (cost < best_cost) {
+                best = candidate;
+                best_cost = cost;
+            }
+        }
+        return best;
+    }
+};
+
+// RotorLB: every packet is queued for its final destination; the engine grants
+// indirection per slot from offers and accepts (Simulator::computeRotorLbGrants)
+struct RotorLbRouting {
+    static constexpr const char* name = "rotorlb";
+    static constexpr bool kPerSlotIndirection = true;
+
+    explicit RotorLbRouting(const SimConfig&) {}
+
+    template <class Sim>
+    bool useDirect(const Sim&, const Packet&, int) const { return true; }
+
+    template <class Sim>
+    int selectIntermediate(const Sim& sim, PhiloxRng& rng, int src, int dst) const {
+        return randomIntermediateRack(sim, rng, src, dst);
+    }
+};
+
+template <class Policy>
+struct RoutingTag {
+    using type = Policy;
+};
+
+// Call f(RoutingTag<Policy>{}) for the policy selected by mode
+template <class F>
+auto dispatchRouting(RoutingMode mode, F&& f) {
+    switch (mode) {
+        case RoutingMode::DIRECT:    return f(RoutingTag<DirectRouting>{});
+        case RoutingMode::VLB:       return f(RoutingTag<VlbRouting>{});
+        case RoutingMode::THRESHOLD: return f(RoutingTag<ThresholdRouting>{});
+        case RoutingMode::POWER_OF_D: return f(RoutingTag<PowerOfDRouting>{});
+        case RoutingMode::ROTORLB:   return f(RoutingTag<RotorLbRouting>{});
+    }
+    return f(RoutingTag<ThresholdRouting>{});
+}
+
+#endif // ROUTING_H
@@ -0,0 +1,154 @@
+// schedule.h - Loading and validating explicit rotor matching schedules
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdint>
+#include <algorithm>
+
+// schedule[switch_id][matching_id][rack_id] = connected_rack_id
+using MatchingSchedule = std::vector<std::vector<std::vector<int>>>;
+
+// Reads per-switch matching sequences from a file, one matching per slot. The cycle
+// is as long as the longest sequence; a switch with a shorter sequence is down for
+// the rest of the cycle. Two formats are accepted:
+//
+//   CSV (any extension but .bin): one matching per line,
+//       switch_id,partner_of_rack_0,partner_of_rack_1,...
+//     A switch's sequence is its lines in file order. Blank lines and lines
+//     starting with '#' are ignored.
+//
+//   Binary (.bin), little-endian:
+//       char[4] "RSCH", uint32 version (1), uint32 num_switches, uint32 num_racks,
+//       then per switch: uint32 num_matchings, num_matchings * num_racks uint16 partners
+//
+// A rack mapped to itself is idle on that switch for the slot. The loaded schedule
+// must match the configured switch and rack counts, every matching must be a
+// permutation of the racks, and the sequences must jointly connect every ordered
+// pair of distinct racks at least once per cycle.
+class ScheduleLoader {
+private:
+    static MatchingSchedule loadCsv(const std::string& filename, int num_switches, int num_racks) {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open schedule file: " + filename);
+        }
+
+        MatchingSchedule schedule(num_switches);
+        std::string line;
+        int line_no = 0;
+        while (std::getline(file, line)) {
+            line_no++;
+            if (line.empty() || line[0] == '#') continue;
+
+            std::stringstream ss(line);
+            std::string field;
+            std::vector<int> values;
+            while (std::getline(ss, field, ',')) {
+                values.push_back(std::stoi(field));
+            }
+            if (static_cast<int>(values.size()) != num_racks + 1) {
+                throw std::runtime_error("Schedule line " + std::to_string(line_no) + ": expected switch id and " +
+                                         std::to_string(num_racks) + " partners");
+            }
+            int switch_id = values[0];
+            if (switch_id < 0 || switch_id >= num_switches) {
+                throw std::runtime_error("Schedule line " + std::to_string(line_no) + ": switch id out of range");
+            }
+            schedule[switch_id].emplace_back(values.begin() + 1, values.end());
+        }
+        return schedule;
+    }
+
+    static uint32_t readU32(std::ifstream& file) {
+        unsigned char b[4];
+        if (!file.read(reinterpret_cast<char*>(b), 4)) {
+            throw std::runtime_error("Truncated binary schedule");
+        }
+        return b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+    }
+
+    static MatchingSchedule loadBinary(const std::string& filename, int num_switches, int num_racks) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open schedule file: " + filename);
+        }
+
+        char magic[4];
+        if (!file.read(magic, 4) || std::string(magic, 4) != "RSCH") {
+            throw std::runtime_error("Not a binary schedule (bad magic): " + filename);
+        }
+        if (readU32(file) != 1) {
+            throw std::runtime_error("Unsupported binary schedule version: " + filename);
+        }
+        if (static_cast<int>(readU32(file)) != num_switches || static_cast<int>(readU32(file)) != num_racks) {
+            throw std::runtime_error("Schedule switch/rack counts do not match the configuration");
+        }
+
+        MatchingSchedule schedule(num_switches);
+        std::vector<unsigned char> buf(2 * num_racks);
+        for (int s = 0; s < num_switches; s++) {
+            uint32_t num_matchings = readU32(file);
+            for (uint32_t m = 0; m < num_matchings; m++) {
+                if (!file.read(reinterpret_cast<char*>(buf.data()), buf.size())) {
+                    throw std::runtime_error("Truncated binary schedule");
+                }
+                std::vector<int> matching(num_racks);
+                for (int r = 0; r < num_racks; r++) {
+                    matching[r] = buf[2 * r] | (buf[2 * r + 1] << 8);
+                }
+                schedule[s].push_back(std::move(matching));
+            }
+        }
+        return schedule;
+    }
+
+public:
+    // Throws std::runtime_error describing the first problem found
+    static void validate(const MatchingSchedule& schedule, int num_racks) {
+        std::vector<char> covered(static_cast<size_t>(num_racks) * num_racks, 0);
+        std::vector<char> seen(num_racks);
+
+        for (size_t s = 0; s < schedule.size(); s++) {
+            if (schedule[s].empty()) {
+                throw std::runtime_error("Schedule: switch " + std::to_string(s) + " has no matchings");
+            }
+            for (size_t m = 0; m < schedule[s].size(); m++) {
+                const std::vector<int>& matching = schedule[s][m];
+                std::fill(seen.begin(), seen.end(), 0);
+                for (int r = 0; r < num_racks; r++) {
+                    int partner = matching[r];
+                    if (partner < 0 || partner >= num_racks || seen[partner]) {
+                        throw std::runtime_error("Schedule: switch " + std::to_string(s) + " matching " +
+                                                 std::to_string(m) + " is not a permutation");
+                    }
+                    seen[partner] = 1;
+                    covered[static_cast<size_t>(r) * num_racks + partner] = 1;
+                }
+            }
+        }
+
+        for (int i = 0; i < num_racks; i++) {
+            for (int j = 0; j < num_racks; j++) {
+                if (i != j && !covered[static_cast<size_t>(i) * num_racks + j]) {
+                    throw std::runtime_error("Schedule never connects rack " + std::to_string(i) +
+                                             " to rack " + std::to_string(j));
+                }
+            }
+        }
+    }
+
+    static MatchingSchedule load(const std::string& filename, int num_switches, int num_racks) {
+        bool binary = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+        MatchingSchedule schedule = binary ? loadBinary(filename, num_switches, num_racks)
+                                           : loadCsv(filename, num_switches, num_racks);
+        validate(schedule, num_racks);
+        return schedule;
+    }
+};
+
+#endif // SCHEDULE_H
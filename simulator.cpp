@@ -1,279 +1,1572 @@
 #include "simulator.h"
+#include "fluid.h"
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/wait.h>
 
-Simulator::Simulator(const SimConfig& cfg) 
-    : config(cfg), topology(cfg), current_time_us(0), 
-      next_packet_id(0), total_bytes_transmitted(0), 
-      DIRECT_THRESHOLD(cfg.queue_threshold) {
+// Trains keep the VOQ occupancy that capacity checks and samples see exact, but
+// a train's packets reach hosts, free lossless credit and reset retransmit
+// backoff only when its event processes them, and second-hop packets arriving
+// mid-train do not preempt a LOCAL train. So trains need direct or vlb routing
+// (no queue-length routing or RotorLB grants) without host downlinks, lossless
+// credit or retransmission.
+static void checkTrainable(const SimConfig& cfg) {
+    if (cfg.packet_train_max_pkts > 1 &&
+        ((cfg.routing != RoutingMode::DIRECT && cfg.routing != RoutingMode::VLB) ||
+         cfg.model_hosts || cfg.lossless || cfg.retransmit)) {
+        throw std::runtime_error("packet_train_max_pkts > 1 needs direct or vlb routing "
+                                 "without model_hosts, lossless or retransmit");
+    }
+}
+
+// A fluid entry always takes its direct VOQ and is never dropped, paused or split
+// across host NICs, so hybrid mode needs direct routing without lossless credit
+// or host modelling: other policies would route an elephant's packets (and the
+// mice queue-length choices see) differently from the packet engine.
+static void checkHybrid(const SimConfig& cfg) {
+    if (cfg.hybrid_fluid_min_bytes > 0 &&
+        (cfg.routing != RoutingMode::DIRECT || cfg.lossless || cfg.model_hosts)) {
+        throw std::runtime_error("hybrid_fluid_min_bytes needs direct routing without lossless or model_hosts");
+    }
+}
+
+SimulatorBase::SimulatorBase(const SimConfig& cfg) 
+    : config(cfg), topology(Topology::create(cfg)), rng(cfg.random_seed, STREAM_SIMULATOR), next_train_id(0), current_time_us(0), 
+      next_packet_id(0), warned_low_latency(false), total_bytes_transmitted(0), 
+      window_offered_bytes(0), window_delivered_bytes(0), window_start_drops(0),
+      stopped_early(false), drain_start_us(-1.0), event_count(0), progress_step_us(0),
+      next_progress_us(0), checkpoint_pending(false) {
     
-    rng.seed(cfg.random_seed + 1000); // Different seed from workload gen
+    if (config.steady_state && config.sample_interval_ms <= 0) {
+        throw std::runtime_error("steady_state needs sample_interval_ms > 0");
+    }
+    checkTrainable(config);
+    checkHybrid(config);
     
     // Initialize rack state and VOQs
     for (int i = 0; i < config.num_racks; i++) {
         rack_voqs.emplace(i, VirtualOutputQueues(i, config.num_racks, config.queue_size_pkts));
-        rack_busy[i] = false;
-        rack_next_free_time[i] = 0.0;
+    }
+    
+    uplink_busy.assign(config.num_racks * config.num_switches, 0);
+    uplink_deferred_until.assign(config.num_racks * config.num_switches, -1.0);
+    
+    slot_budget_bytes = (topology->getSlotTime() - config.reconfig_delay_us) * config.link_rate_gbps * 1e3 / 8.0;
+    
+    rack_ingress.resize(config.num_racks);
+    rotorlb_grants.resize(config.num_racks);
+    rotorlb_granted_until.assign(config.num_racks * config.num_switches, -1.0);
+    
+    if (config.model_hosts) {
+        host_nics.resize(config.num_racks * config.hosts_per_rack);
+        host_downlinks.resize(config.num_racks * config.hosts_per_rack);
+    }
+    
+    if (config.packet_switch_gbps > 0) {
+        packet_switch = PacketSwitch(config.num_racks, config.packet_switch_queue_pkts);
     }
 }
 
-void Simulator::run() {
-    std::cout << "Generating workload..." << std::endl;
-    WorkloadGenerator wg(config);
-    std::vector<Flow> flow_list;
+// Topology, VOQs, uplinks and ports were sized and timed by the prefix's config, and
+// credit-based modes keep invariants a switch mid-run would break, so a variant may
+// not change them. The workload generator keeps the prefix's config as well, so a
+// variant may not change the arrivals either: every variant sees the base run's.
+// Routing draws pair up only if all variants take them the same way, so
+// common_random_numbers is fixed too. A variant must change something the rest of
+// the run depends on, or it would silently repeat the base run.
+static void checkBranchable(const SimConfig& base, const SimConfig& variant) {
+    if (variant.num_racks != base.num_racks || variant.num_switches != base.num_switches ||
+        variant.hosts_per_rack != base.hosts_per_rack || variant.model_hosts != base.model_hosts ||
+        variant.queue_size_pkts != base.queue_size_pkts ||
+        variant.packet_switch_queue_pkts != base.packet_switch_queue_pkts ||
+        (variant.packet_switch_gbps > 0) != (base.packet_switch_gbps > 0) ||
+        variant.lossless != base.lossless ||
+        (variant.routing == RoutingMode::ROTORLB) != (base.routing == RoutingMode::ROTORLB) ||
+        (variant.hybrid_fluid_min_bytes > 0) != (base.hybrid_fluid_min_bytes > 0) ||
+        variant.topology != base.topology || variant.schedule_file != base.schedule_file ||
+        variant.reconfig_delay_us != base.reconfig_delay_us || variant.duty_cycle != base.duty_cycle ||
+        variant.link_rate_gbps != base.link_rate_gbps || variant.mtu_bytes != base.mtu_bytes ||
+        variant.engine != base.engine || variant.common_random_numbers != base.common_random_numbers) {
+        throw std::runtime_error("Branch variants may not change the network shape or timing, "
+                                 "buffer sizes, lossless/RotorLB/hybrid mode, the engine "
+                                 "or common_random_numbers");
+    }
+    if (variant.sim_time_ms != base.sim_time_ms || variant.load_factor != base.load_factor ||
+        variant.workload != base.workload || variant.random_seed != base.random_seed ||
+        variant.flow_file != base.flow_file ||
+        variant.low_latency_threshold_bytes != base.low_latency_threshold_bytes ||
+        variant.load_profile != base.load_profile || variant.load_schedule != base.load_schedule ||
+        variant.onoff_on_load != base.onoff_on_load || variant.onoff_off_load != base.onoff_off_load ||
+        variant.onoff_mean_on_ms != base.onoff_mean_on_ms || variant.onoff_mean_off_ms != base.onoff_mean_off_ms ||
+        variant.ramp_end_load != base.ramp_end_load || variant.diurnal_period_ms != base.diurnal_period_ms ||
+        variant.diurnal_amplitude != base.diurnal_amplitude) {
+        throw std::runtime_error("Branch variants share the base run's arrivals and may not change "
+                                 "sim_time_ms, load_factor, workload, random_seed, flow_file or the load profile");
+    }
+    if (variant.routing == base.routing && variant.queue_threshold == base.queue_threshold &&
+        variant.routing_choices == base.routing_choices && variant.path_pinning == base.path_pinning &&
+        variant.flowlet_gap_us == base.flowlet_gap_us && variant.propagation_delay_us == base.propagation_delay_us &&
+        variant.packet_switch_gbps == base.packet_switch_gbps &&
+        variant.hybrid_fluid_min_bytes == base.hybrid_fluid_min_bytes &&
+        variant.packet_train_max_pkts == base.packet_train_max_pkts && variant.drain_cap_ms == base.drain_cap_ms &&
+        variant.steady_state == base.steady_state && variant.steady_ci_target == base.steady_ci_target &&
+        variant.retransmit == base.retransmit && variant.rto_us == base.rto_us) {
+        throw std::runtime_error("Branch variant changes nothing the rest of the run depends on");
+    }
+}
+
+SimulatorBase::SimulatorBase(const SimConfig& cfg, SimulatorBase&& prefix)
+    : config(cfg), topology(std::move(prefix.topology)), stats(std::move(prefix.stats)),
+      rng(prefix.rng), event_queue(std::move(prefix.event_queue)),
+      flows(std::move(prefix.flows)), packets(std::move(prefix.packets)),
+      finished_flows(std::move(prefix.finished_flows)),
+      trains(std::move(prefix.trains)), next_train_id(prefix.next_train_id),
+      workload(std::move(prefix.workload)), current_time_us(prefix.current_time_us),
+      end_time_us(prefix.end_time_us), next_packet_id(prefix.next_packet_id),
+      rack_voqs(std::move(prefix.rack_voqs)), uplink_busy(std::move(prefix.uplink_busy)),
+      uplink_deferred_until(std::move(prefix.uplink_deferred_until)),
+      slot_budget_bytes(prefix.slot_budget_bytes), host_nics(std::move(prefix.host_nics)),
+      host_downlinks(std::move(prefix.host_downlinks)), rack_ingress(std::move(prefix.rack_ingress)),
+      packet_switch(std::move(prefix.packet_switch)), warned_low_latency(prefix.warned_low_latency),
+      rotorlb_grants(std::move(prefix.rotorlb_grants)),
+      rotorlb_granted_until(std::move(prefix.rotorlb_granted_until)),
+      total_bytes_transmitted(prefix.total_bytes_transmitted),
+      window_offered_bytes(prefix.window_offered_bytes),
+      window_delivered_bytes(prefix.window_delivered_bytes),
+      window_start_drops(prefix.window_start_drops), steady(std::move(prefix.steady)),
+      stopped_early(prefix.stopped_early), drain_start_us(prefix.drain_start_us), event_count(prefix.event_count),
+      progress_step_us(0), next_progress_us(0), checkpoint_pending(false) {
     
-    // Load or generate flows
-    if (!config.flow_file.empty()) {
-        flow_list = wg.loadFlowsFromFile(config.flow_file);
-    } else {
-        flow_list = wg.generateFlows();
+    checkBranchable(prefix.config, cfg);
+    checkTrainable(cfg);
+    checkHybrid(cfg);
+    resetRunClock();
+}
+
+template <class RoutingPolicy>
+Simulator<RoutingPolicy>::Simulator(const SimConfig& cfg)
+    : SimulatorBase(cfg), routing(cfg) {
+}
+
+template <class RoutingPolicy>
+Simulator<RoutingPolicy>::Simulator(const SimConfig& cfg, SimulatorBase&& prefix)
+    : SimulatorBase(cfg, std::move(prefix)), routing(cfg) {
+}
+
+void SimulatorBase::startRun() {
+    if (!config.quiet) std::cout << "Generating workload..." << std::endl;
+    
+    // Resume a checkpoint, load flows from file, or pull them lazily from the generator
+    if (!config.restore_file.empty()) {
+        loadCheckpoint(config.restore_file);
+        if (workload && config.save_flows) {
+            workload->openFlowLog(config.flow_output_file);
+        }
+        if (!config.quiet) std::cout << "Restored " << config.restore_file << " at " << current_time_us / 1000.0 << " ms" << std::endl;
+    } else if (shared_flows) {
+        // Each run copies the flows it mutates; the list itself stays shared
+        for (const Flow& flow : *shared_flows) {
+            flows[flow.id] = flow;
+            scheduleEvent(EventType::FLOW_ARRIVAL, flow.start_time * 1000.0, flow.id);
+        }
+    } else if (!config.flow_file.empty()) {
+        WorkloadGenerator wg(config);
+        std::vector<Flow> flow_list = wg.loadFlowsFromFile(config.flow_file);
+        
+        // Add flows to map and schedule arrivals
+        for (auto& flow : flow_list) {
+            flows[flow.id] = flow;
+            scheduleEvent(EventType::FLOW_ARRIVAL, 
+                         flow.start_time * 1000.0, flow.id); // Convert ms to us
+        }
+    } else if (config.workload_threads != 1) {
+        // Generate the whole arrival window up front in parallel
+        WorkloadGenerator wg(config);
+        std::vector<Flow> flow_list = wg.generateFlows(config.workload_threads);
         if (config.save_flows) {
             wg.saveFlowsToFile(flow_list, config.flow_output_file);
         }
+        for (auto& flow : flow_list) {
+            scheduleEvent(EventType::FLOW_ARRIVAL, flow.start_time * 1000.0, flow.id);
+            flows[flow.id] = std::move(flow);
+        }
+    } else {
+        workload.reset(new WorkloadGenerator(config));
+        if (config.save_flows) {
+            workload->openFlowLog(config.flow_output_file);
+        }
+        scheduleNextGeneratedFlow();
     }
     
-    // Add flows to map and schedule arrivals
-    for (auto& flow : flow_list) {
-        flows[flow.id] = flow;
-        scheduleEvent(EventType::FLOW_ARRIVAL, 
-                     flow.start_time * 1000.0, flow.id); // Convert ms to us
+    if (config.restore_file.empty()) {
+        scheduleEvent(EventType::SLOT_BOUNDARY, topology->getNextCircuitUpTime(0.0), 0);
+        
+        if (config.sample_interval_ms > 0) {
+            scheduleEvent(EventType::STATS_SAMPLE, config.sample_interval_ms * 1000.0, 0);
+        }
     }
     
-    std::cout << "Running simulation..." << std::endl;
-    int event_count = 0;
-    int progress_interval = event_queue.size() / 20; // 5% progress updates
-    if (progress_interval == 0) progress_interval = 1000;
+    if (config.stream_fcts) {
+        stats.streamFctsToSketch();
+    }
+    
+    if (!config.quiet) std::cout << "Running simulation..." << std::endl;
+    event_count = 0;
+    resetRunClock();
+#ifdef PROFILE
+    profiler.startClock();
+#endif
+}
 
-    // Set the sim end time
+void SimulatorBase::resetRunClock() {
     end_time_us = config.sim_time_ms * 1000.0;
-    
+    progress_step_us = end_time_us / 20; // 5% progress updates
+    next_progress_us = progress_step_us;
+    while (next_progress_us <= current_time_us) next_progress_us += progress_step_us;
+    checkpoint_pending = config.checkpoint_time_ms >= 0 &&
+                         config.checkpoint_time_ms * 1000.0 >= current_time_us;
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::run() {
+    startRun();
+    finish();
+}
+
+template <class RoutingPolicy>
+inline void Simulator<RoutingPolicy>::processEvent(const Event& evt) {
+#ifdef PROFILE
+    profiler.beginEvent(event_queue.size());
+#endif
+    switch (evt.type) {
+        case EventType::FLOW_ARRIVAL:
+            handleFlowArrival(evt.id);
+            break;
+        case EventType::PACKET_ARRIVAL:
+            handlePacketArrival(evt.id);
+            break;
+        case EventType::PACKET_TRANSMISSION_COMPLETE:
+            handlePacketTransmissionComplete(evt.id);
+            break;
+        case EventType::TRAIN_TRANSMISSION_COMPLETE:
+            handleTrainTransmissionComplete(evt.id);
+            break;
+        case EventType::FLUID_CHUNK_COMPLETE:
+            handleFluidChunkComplete(evt.id);
+            break;
+        case EventType::PACKET_SWITCH_ARRIVAL:
+            handlePacketSwitchArrival(evt.id);
+            break;
+        case EventType::PACKET_SWITCH_DEPARTURE:
+            handlePacketSwitchDeparture(evt.id);
+            break;
+        case EventType::STATS_SAMPLE:
+            handleStatsSample();
+            break;
+        case EventType::HOST_TRANSMISSION_COMPLETE:
+            handleHostTransmissionComplete(evt.id);
+            break;
+        case EventType::SLOT_BOUNDARY:
+            handleSlotBoundary();
+            break;
+        case EventType::RETRANSMIT_TIMEOUT:
+            handleRetransmitTimeout(evt.id);
+            break;
+    }
+#ifdef PROFILE
+    profiler.endEvent(static_cast<size_t>(evt.type));
+#endif
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::runUntil(double time_us) {
     while (!event_queue.empty()) {
         Event evt = event_queue.top();
-        if (evt.time_us > end_time_us) // Stop simulation
-        {
-            std::cout << "Simulation: Next event time: " << evt.time_us << "us, exceeds endTime: "
-                << end_time_us <<"us. Stopping\n" << std::endl;
-            break; // stop simulation at configured time
+        if (checkpoint_pending && evt.time_us > config.checkpoint_time_ms * 1000.0) {
+            saveCheckpoint(config.checkpoint_file);
+            checkpoint_pending = false;
+        }
+        if (evt.time_us > time_us || evt.time_us > end_time_us) {
+            break;
         }
-        event_queue.pop();
+        popEvent();
         
         current_time_us = evt.time_us;
-        
-        switch (evt.type) {
-            case EventType::FLOW_ARRIVAL:
-                handleFlowArrival(evt.id);
-                break;
-            case EventType::PACKET_ARRIVAL:
-                handlePacketArrival(evt.id);
-                break;
-            case EventType::PACKET_TRANSMISSION_COMPLETE:
-                handlePacketTransmissionComplete(evt.id);
-                break;
-        }
+        processEvent(evt);
         
         event_count++;
-        if (event_count % progress_interval == 0) {
-            double progress = 100.0 * current_time_us / (config.sim_time_ms * 1000.0);
+        if (current_time_us >= next_progress_us && !config.quiet) {
+            double progress = 100.0 * current_time_us / end_time_us;
             std::cout << "  Progress: " << std::fixed << std::setprecision(1) 
-                     << progress << "%" << std::endl;
+                     << progress << "% (" << event_count << " events)" << std::endl;
+            while (next_progress_us <= current_time_us) next_progress_us += progress_step_us;
+        }
+    }
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::drain() {
+    drain_start_us = end_time_us;
+    double cap_us = drain_start_us + config.drain_cap_ms * 1000.0;
+    
+    // Flows that started in the window and are not finished yet (completed
+    // flows leave the map)
+    std::vector<uint64_t> open_flows;
+    for (const auto& pair : flows) {
+        if (pair.second.start_time * 1000.0 <= drain_start_us) {
+            open_flows.push_back(pair.first);
+        }
+    }
+    
+    // Arrivals after the window (flow_file) never start
+    std::vector<Event> pending;
+    pending.reserve(event_queue.size());
+    for (; !event_queue.empty(); event_queue.pop()) {
+        if (event_queue.top().type != EventType::FLOW_ARRIVAL) pending.push_back(event_queue.top());
+    }
+    for (const Event& evt : pending) event_queue.push(evt);
+    
+    // No arrivals, checkpoints or progress output from here on: the loop only
+    // checks the cap, and whether anything is left to finish once per slot
+    uint64_t drain_events = 0;
+    while (!open_flows.empty() && !event_queue.empty()) {
+        Event evt = event_queue.top();
+        if (evt.time_us > cap_us) {
+            break;
+        }
+        popEvent();
+        
+        current_time_us = evt.time_us;
+        processEvent(evt);
+        drain_events++;
+        
+        if (evt.type == EventType::SLOT_BOUNDARY) {
+            open_flows.erase(std::remove_if(open_flows.begin(), open_flows.end(),
+                                            [this](uint64_t id) { return flows.count(id) == 0; }),
+                             open_flows.end());
+            if (isNetworkIdle()) {
+                break;  // Only dropped packets remain: the open flows can never finish
+            }
+        }
+    }
+    event_count += drain_events;
+    end_time_us = !event_queue.empty() && event_queue.top().time_us > cap_us ? cap_us : current_time_us;
+    if (!config.quiet) {
+        std::cout << "Drained " << (end_time_us - drain_start_us) / 1000.0 << " ms after the arrival window ("
+                  << drain_events << " events, " << open_flows.size() << " flows left)" << std::endl;
+    }
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::finish() {
+    runUntil(end_time_us);
+    if (config.drain_cap_ms > 0 && !stopped_early) {
+        drain();
+    } else if (!event_queue.empty() && !config.quiet) { // Stop simulation at configured time
+        std::cout << "Simulation: Next event time: " << event_queue.top().time_us << "us, exceeds endTime: "
+            << end_time_us <<"us. Stopping\n" << std::endl;
+    }
+    advanceTrains(end_time_us);
+    
+#ifdef PROFILE
+    profiler.stopClock();
+    EventProfiler::global().merge(profiler);
+#endif
+    
+    if (!config.quiet) std::cout << "Simulation complete. Collecting statistics..." << std::endl;
+    collectStatistics();
+}
+
+bool SimulatorBase::isNetworkIdle() const {
+    // Only the periodic slot boundary and stats sample are pending
+    size_t periodic_events = config.sample_interval_ms > 0 ? 2 : 1;
+    if (event_queue.size() > periodic_events) return false;
+    for (const auto& pair : rack_voqs) {
+        if (pair.second.getTotalPackets() > 0) return false;
+    }
+    for (const RackIngress& ingress : rack_ingress) {
+        if (!ingress.held.empty()) return false;
+    }
+    for (const HostNic& nic : host_nics) {
+        if (nic.hasFlows() || nic.hasRetransmissions()) return false;
+    }
+    return true;
+}
+
+void SimulatorBase::collectStatistics() {
+    // Collect statistics, leaving out flows that started during the warm-up
+    double warmup_ms = -1.0;
+    if (config.steady_state) {
+        long warmup_samples = steady.getWarmupSamples();
+        if (warmup_samples >= 0) {
+            warmup_ms = warmup_samples * config.sample_interval_ms;
+        } else {
+            std::cerr << "Warning: steady state not reached; no warm-up trimmed" << std::endl;
+        }
+    }
+    // Completed flows are only records now; merge them with the unfinished ones
+    // in flow id order
+    std::vector<FlowRecord> finished = finished_flows;
+    std::sort(finished.begin(), finished.end(),
+              [](const FlowRecord& a, const FlowRecord& b) { return a.id < b.id; });
+    auto next_finished = finished.begin();
+    auto next_open = flows.begin();
+    int warmup_flows = 0;
+    std::vector<double> censored_ages_ms;
+    while (next_finished != finished.end() || next_open != flows.end()) {
+        if (next_open == flows.end() || (next_finished != finished.end() && next_finished->id < next_open->first)) {
+            const FlowRecord& record = *next_finished++;
+            if (record.start_time < warmup_ms) {
+                warmup_flows++;
+            } else {
+                stats.addCompletedFlow(record.fct, record.type);
+            }
+            continue;
+        }
+        const Flow& flow = (next_open++)->second;
+        if (flow.start_time < warmup_ms) {
+            warmup_flows++;
+            continue;
+        }
+        // Flows from a file that would have started after an early stop, or
+        // during the drain, never ran
+        if (stopped_early && flow.start_time * 1000.0 > end_time_us) continue;
+        if (drain_start_us >= 0 && flow.start_time * 1000.0 > drain_start_us) continue;
+        if (drain_start_us >= 0) {
+            censored_ages_ms.push_back(end_time_us / 1000.0 - flow.start_time);
         }
+        stats.addFlow(flow);
+    }
+    if (config.steady_state) {
+        stats.setSteadyState(warmup_ms, warmup_flows, stopped_early ? end_time_us / 1000.0 : -1.0);
+    }
+    if (drain_start_us >= 0) {
+        stats.setDrain((end_time_us - drain_start_us) / 1000.0, censored_ages_ms);
     }
     
-    std::cout << "Simulation complete. Collecting statistics..." << std::endl;
+    if (config.lossless) {
+        std::vector<double> paused_ms;
+        for (auto& ingress : rack_ingress) {
+            double paused_us = ingress.paused_us;
+            if (!ingress.held.empty()) paused_us += current_time_us - ingress.pause_start_us;
+            paused_ms.push_back(paused_us / 1000.0);
+        }
+        stats.setRackPausedTimes(paused_ms);
+    }
     
-    // Collect statistics
-    for (auto& pair : flows) {
-        stats.addFlow(pair.second);
+    // Hybrid: credit the whole packets of in-flight fluid chunks that were sent by the end
+    if (config.hybrid_fluid_min_bytes > 0) {
+        for (const auto& pair : packets) {
+            const Packet& pkt = pair.second;
+            if (!pkt.fluid || pkt.fluid_chunk_bytes == 0) continue;
+            double elapsed_us = end_time_us - pkt.sent_time * 1000.0;
+            uint64_t sent_pkts = static_cast<uint64_t>(elapsed_us / getTxTimeUs(config.mtu_bytes));
+            total_bytes_transmitted += std::min(pkt.fluid_chunk_bytes, sent_pkts * config.mtu_bytes);
+        }
     }
     
-    double sim_time_s = config.sim_time_ms / 1000.0;
+    double run_time_ms = stopped_early || drain_start_us >= 0 ? end_time_us / 1000.0 : config.sim_time_ms;
+    double sim_time_s = run_time_ms / 1000.0;
     double throughput_gbps = (total_bytes_transmitted * 8.0) / (sim_time_s * 1e9);
     stats.setTotalThroughput(throughput_gbps);
-    stats.setSimTime(config.sim_time_ms);
+    stats.setSimTime(run_time_ms);
+    
+    double circuit_slots = static_cast<double>(config.num_racks) * config.num_switches *
+                           (end_time_us / topology->getSlotTime());
+    stats.setCircuitCapacityBytes(circuit_slots * slot_budget_bytes);
 }
 
-Statistics Simulator::getStatistics() const {
+Statistics SimulatorBase::getStatistics() const {
     return stats;
 }
 
-void Simulator::enqueuePacket(uint64_t packet_id, int current_rack) {
+void SimulatorBase::saveCheckpoint(const std::string& filename) const {
+    CheckpointWriter out;
+    
+    // Shape of the state and the modes whose invariants it carries, checked
+    // against the restoring config
+    out.put<int32_t>(config.num_racks);
+    out.put<int32_t>(config.num_switches);
+    out.put<int32_t>(config.hosts_per_rack);
+    out.put<int32_t>(config.queue_size_pkts);
+    out.put<int32_t>(config.packet_switch_queue_pkts);
+    out.put<uint8_t>(config.model_hosts);
+    out.put<uint8_t>(config.packet_switch_gbps > 0);
+    out.put<uint8_t>(config.lossless);
+    out.put<uint8_t>(config.routing == RoutingMode::ROTORLB);
+    out.put<uint8_t>(config.hybrid_fluid_min_bytes > 0);
+    out.put<uint8_t>(workload != nullptr);
+    
+    out.put(current_time_us);
+    out.put(next_packet_id);
+    out.put(next_train_id);
+    
+    auto events = event_queue;
+    std::vector<Event> pending;
+    pending.reserve(events.size());
+    for (; !events.empty(); events.pop()) pending.push_back(events.top());
+    out.putVector(pending);
+    
+    out.put<uint64_t>(flows.size());
+    for (const auto& pair : flows) pair.second.save(out);
+    out.putVector(finished_flows);
+    
+    std::vector<Packet> live;
+    live.reserve(packets.size());
+    for (const auto& pair : packets) live.push_back(pair.second);
+    out.putVector(live);
+    
+    out.put<uint64_t>(trains.size());
+    for (const auto& pair : trains) {
+        const PacketTrain& train = pair.second;
+        out.put(pair.first);
+        out.put<int32_t>(train.rack);
+        out.put<int32_t>(train.switch_id);
+        out.put(train.start_us);
+        out.put(train.bytes);
+        out.putVector(train.packet_ids);
+    }
+    
+    if (workload) workload->save(out);
+    
+    for (const auto& pair : rack_voqs) pair.second.save(out);
+    out.putVector(uplink_busy);
+    out.putVector(uplink_deferred_until);
+    for (const auto& nic : host_nics) nic.save(out);
+    for (const auto& downlink : host_downlinks) downlink.save(out);
+    for (const auto& ingress : rack_ingress) {
+        out.putDeque(ingress.held);
+        out.putVector(ingress.paused_nics);
+        out.put(ingress.pause_start_us);
+        out.put(ingress.paused_us);
+    }
+    packet_switch.save(out);
+    out.put<uint8_t>(warned_low_latency);
+    for (const auto& grants : rotorlb_grants) out.putVector(grants);
+    out.putVector(rotorlb_granted_until);
+    
+    rng.save(out);
+    stats.save(out);
+    out.put(total_bytes_transmitted);
+    out.put(window_offered_bytes);
+    out.put(window_delivered_bytes);
+    out.put<int32_t>(window_start_drops);
+    steady.save(out);
+    out.put<uint8_t>(stopped_early);
+    
+    out.writeFile(filename);
+    if (!config.quiet) std::cout << "Checkpoint saved to " << filename << " at " << current_time_us / 1000.0 << " ms" << std::endl;
+}
+
+void SimulatorBase::loadCheckpoint(const std::string& filename) {
+    CheckpointReader in(filename);
+    
+    if (in.get<int32_t>() != config.num_racks || in.get<int32_t>() != config.num_switches ||
+        in.get<int32_t>() != config.hosts_per_rack || in.get<int32_t>() != config.queue_size_pkts ||
+        in.get<int32_t>() != config.packet_switch_queue_pkts || in.get<uint8_t>() != config.model_hosts ||
+        in.get<uint8_t>() != (config.packet_switch_gbps > 0) || in.get<uint8_t>() != config.lossless ||
+        in.get<uint8_t>() != (config.routing == RoutingMode::ROTORLB) ||
+        in.get<uint8_t>() != (config.hybrid_fluid_min_bytes > 0)) {
+        throw std::runtime_error("Checkpoint " + filename + " was written for a different network or mode");
+    }
+    bool has_workload = in.get<uint8_t>();
+    
+    in.get(current_time_us);
+    in.get(next_packet_id);
+    in.get(next_train_id);
+    
+    std::vector<Event> pending;
+    in.getVector(pending);
+    event_queue = decltype(event_queue)(std::greater<Event>(), std::move(pending));
+    
+    flows.clear();
+    uint64_t num_flows = in.get<uint64_t>();
+    for (uint64_t i = 0; i < num_flows; i++) {
+        Flow flow;
+        flow.load(in);
+        flows.emplace_hint(flows.end(), flow.id, std::move(flow));
+    }
+    in.getVector(finished_flows);
+    
+    std::vector<Packet> live;
+    in.getVector(live);
+    packets.clear();
+    for (const Packet& pkt : live) packets.emplace_hint(packets.end(), pkt.id, pkt);
+    
+    trains.clear();
+    uint64_t num_trains = in.get<uint64_t>();
+    for (uint64_t i = 0; i < num_trains; i++) {
+        uint64_t id = in.get<uint64_t>();
+        PacketTrain& train = trains[id];
+        train.rack = in.get<int32_t>();
+        train.switch_id = in.get<int32_t>();
+        in.get(train.start_us);
+        in.get(train.bytes);
+        in.getVector(train.packet_ids);
+    }
+    
+    workload.reset();
+    if (has_workload) {
+        workload.reset(new WorkloadGenerator(config));
+        workload->load(in);
+    }
+    
+    for (auto& pair : rack_voqs) pair.second.load(in);
+    in.getVector(uplink_busy);
+    in.getVector(uplink_deferred_until);
+    for (auto& nic : host_nics) nic.load(in);
+    for (auto& downlink : host_downlinks) downlink.load(in);
+    for (auto& ingress : rack_ingress) {
+        in.getDeque(ingress.held);
+        in.getVector(ingress.paused_nics);
+        in.get(ingress.pause_start_us);
+        in.get(ingress.paused_us);
+    }
+    packet_switch.load(in);
+    warned_low_latency = in.get<uint8_t>();
+    for (auto& grants : rotorlb_grants) in.getVector(grants);
+    in.getVector(rotorlb_granted_until);
+    
+    rng.load(in);
+    stats.load(in);
+    in.get(total_bytes_transmitted);
+    in.get(window_offered_bytes);
+    in.get(window_delivered_bytes);
+    window_start_drops = in.get<int32_t>();
+    steady.load(in);
+    stopped_early = in.get<uint8_t>();
+    
+    if (!in.atEnd()) {
+        throw std::runtime_error("Trailing data in checkpoint " + filename);
+    }
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::enqueuePacket(uint64_t packet_id, int current_rack) {
     Packet& pkt = packets[packet_id];
     VirtualOutputQueues& voq = rack_voqs.at(current_rack);
     bool queueSuccess = false;
+    // Train packets that start at this very time have not left yet
+    voq.releaseTrainPackets(current_time_us, false);
+
+    // Hybrid RotorNet: low-latency packets bypass the rotor VOQs
+    if (pkt.type == FlowType::LOW_LATENCY && pkt.hop_count == 0 && config.packet_switch_gbps > 0) {
+        sendToPacketSwitch(packet_id, current_rack);
+        return;
+    }
 
     // Case 1: Packet on second hop (must reach final dst now)
     if (pkt.hop_count == 1) {
         pkt.current_dst = pkt.final_dst;
         queueSuccess = voq.enqueue(packet_id, pkt.final_dst, VoqType::NONLOCAL);
     } 
-    // Case 2: Packet on first hop - decide direct vs VLB
-    else {
-        if (shouldUseDirect(pkt, current_rack)) {
-            pkt.current_dst = pkt.final_dst;
-            queueSuccess = voq.enqueue(packet_id, pkt.final_dst, VoqType::LOCAL);  // ← Fixed!
-        } else {
-            int intermediate = selectIntermediateRack(pkt.current_rack, pkt.final_dst);
-            pkt.current_dst = intermediate;
-            queueSuccess = voq.enqueue(packet_id, intermediate, VoqType::LOCAL);
-        }
+    // Case 2: Packet on first hop - decide direct vs VLB.
+    // While a lossless rack is paused, new packets queue behind the held ones.
+    else if (!(config.lossless && !rack_ingress[current_rack].held.empty())) {
+        queueSuccess = tryEnqueueAtSource(packet_id, current_rack);
     }
 
     // Check enqueue success
     if (!queueSuccess) {
-        pkt.dropped = true;
-        stats.addDroppedPacket();
+        if (config.lossless && pkt.hop_count == 0) {
+            holdPacket(packet_id, current_rack);
+            return;
+        }
+        dropPacket(packet_id);
         return;
     }
 
-    // If rack is not busy, start transmission
-    if (!rack_busy[current_rack]) {
-        startTransmission(current_rack);
+    // Start transmission on any idle uplink
+    startTransmission(current_rack);
+}
+
+template <class RoutingPolicy>
+bool Simulator<RoutingPolicy>::tryEnqueueAtSource(uint64_t packet_id, int current_rack) {
+    Packet& pkt = packets[packet_id];
+    VirtualOutputQueues& voq = rack_voqs.at(current_rack);
+
+    // RotorLB queues everything by final destination; indirection is decided
+    // per slot from offers and accepts (see computeRotorLbGrants)
+    int intermediate = RoutingPolicy::kPerSlotIndirection ? Flow::PATH_DIRECT : selectPath(pkt, current_rack);
+    if (intermediate == Flow::PATH_DIRECT) {
+        pkt.current_dst = pkt.final_dst;
+        return voq.enqueue(packet_id, pkt.final_dst, VoqType::LOCAL);
+    }
+
+    VirtualOutputQueues& intermediate_voq = rack_voqs.at(intermediate);
+
+    // Lossless: only send VLB traffic the intermediate has granted buffer for;
+    // otherwise wait for the direct circuit
+    if (config.lossless && !intermediate_voq.hasNonlocalCredit(pkt.final_dst)) {
+        pkt.current_dst = pkt.final_dst;
+        return voq.enqueue(packet_id, pkt.final_dst, VoqType::LOCAL);
+    }
+
+    pkt.current_dst = intermediate;
+    if (!voq.enqueue(packet_id, intermediate, VoqType::LOCAL)) {
+        return false;
+    }
+    if (config.lossless) {
+        intermediate_voq.reserveNonlocal(pkt.final_dst);
+    }
+    return true;
+}
+
+template <class RoutingPolicy>
+int Simulator<RoutingPolicy>::selectPath(const Packet& pkt, int current_rack) {
+    Flow& flow = flows[pkt.flow_id];
+    double idle_us = current_time_us - flow.last_enqueue_us;
+    flow.last_enqueue_us = current_time_us;
+    
+    // Reuse the pinned path for the rest of the flow, or of the flowlet
+    if (flow.pinned_path != Flow::PATH_UNPINNED &&
+        (config.path_pinning == PathPinning::FLOW ||
+         (config.path_pinning == PathPinning::FLOWLET && idle_us < config.flowlet_gap_us))) {
+        return flow.pinned_path;
+    }
+    
+    if (routing.useDirect(*this, pkt, current_rack)) {
+        flow.pinned_path = Flow::PATH_DIRECT;
+    } else {
+        if (config.common_random_numbers) {
+            // Draw from this packet's own substream, so every run of a sweep gives
+            // it the same candidates regardless of the decisions made before it.
+            // The shared stream is left untouched.
+            PhiloxRng packet_rng(config.random_seed, STREAM_FLOW_DECISIONS + pkt.flow_id);
+            packet_rng.seek(static_cast<uint64_t>(pkt.seq) << 32);
+            flow.pinned_path = routing.selectIntermediate(*this, packet_rng, current_rack, pkt.final_dst);
+        } else {
+            flow.pinned_path = routing.selectIntermediate(*this, rng, current_rack, pkt.final_dst);
+        }
+    }
+    return flow.pinned_path;
+}
+
+void SimulatorBase::dropPacket(uint64_t packet_id) {
+    Packet& pkt = packets[packet_id];
+    pkt.dropped = true;
+    stats.addDroppedPacket();
+    
+    Flow& flow = flows[pkt.flow_id];
+    if (!config.retransmit) {
+        // Never repaired: the receiver skips the hole so its reorder buffer
+        // measures reordering rather than loss
+        flow.reorder.skip(pkt.seq, flow.getNumPackets(config.mtu_bytes));
+        packets.erase(packet_id);
+        return;
+    }
+    
+    // The receiver reports the hole (SACK); the sender resends it when its
+    // retransmission timer for the flow expires
+    flow.lost_packets.push_back(packet_id);
+    if (flow.rto_deadline_us < 0) {
+        double rto_us = getRtoUs() * (1 << flow.rto_backoff);
+        flow.rto_deadline_us = std::max(current_time_us, pkt.creation_time * 1000.0 + rto_us);
+        scheduleEvent(EventType::RETRANSMIT_TIMEOUT, flow.rto_deadline_us, flow.id);
+    }
+}
+
+double SimulatorBase::getRtoUs() const {
+    // Default: a packet may wait up to a cycle for each of its two hops
+    return config.rto_us > 0 ? config.rto_us : 3.0 * topology->getCycleTime();
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::handleRetransmitTimeout(uint64_t flow_id) {
+    Flow& flow = flows[flow_id];
+    
+    // One timer per flow: dropPacket only arms it when none is pending
+    flow.rto_deadline_us = -1.0;
+    if (flow.rto_backoff < MAX_RTO_BACKOFF) flow.rto_backoff++;
+    
+    std::vector<uint64_t> lost;
+    lost.swap(flow.lost_packets);
+    for (uint64_t packet_id : lost) {
+        Packet& pkt = packets[packet_id];
+        pkt.dropped = false;
+        pkt.hop_count = 0;
+        pkt.current_rack = pkt.src_rack;
+        pkt.current_dst = pkt.final_dst;
+        pkt.creation_time = current_time_us / 1000.0;
+        stats.addRetransmittedPacket();
+        
+        if (config.model_hosts) {
+            int host = getHostIndex(pkt.src_rack, pkt.src_host);
+            host_nics[host].addRetransmission(packet_id);
+            if (!host_nics[host].isBusy()) {
+                startHostTransmission(host);
+            }
+        } else {
+            enqueuePacket(packet_id, pkt.src_rack);
+        }
+    }
+}
+
+void SimulatorBase::holdPacket(uint64_t packet_id, int rack_id) {
+    RackIngress& ingress = rack_ingress[rack_id];
+    if (ingress.held.empty()) {
+        ingress.pause_start_us = current_time_us;
+    }
+    ingress.held.push_back(packet_id);
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::admitHeldPackets(int rack_id) {
+    RackIngress& ingress = rack_ingress[rack_id];
+    if (ingress.held.empty()) return;
+
+    while (!ingress.held.empty() && tryEnqueueAtSource(ingress.held.front(), rack_id)) {
+        ingress.held.pop_front();
+    }
+    if (!ingress.held.empty()) return;
+
+    // Unpause: account the paused interval and resume the hosts we stopped
+    ingress.paused_us += current_time_us - ingress.pause_start_us;
+    std::vector<int> resumed;
+    resumed.swap(ingress.paused_nics);
+    for (int host : resumed) {
+        host_nics[host].setPaused(false);
+        if (!host_nics[host].isBusy()) {
+            startHostTransmission(host);
+        }
+    }
+}
+
+int SimulatorBase::getSlotCapacityPkts() const {
+    return static_cast<int>(slot_budget_bytes / config.mtu_bytes);
+}
+
+int SimulatorBase::getCircuitCapacityPkts(double circuit_down_us) const {
+    // Same tolerance as fitsInCircuit; a freshly reconfigured circuit carries a full slot
+    double bytes = (circuit_down_us - current_time_us + 1e-9) * config.link_rate_gbps * 1e3 / 8.0;
+    return std::min(getSlotCapacityPkts(), static_cast<int>(bytes / config.mtu_bytes));
+}
+
+bool SimulatorBase::fitsInCircuit(uint64_t packet_id, double circuit_down_us) const {
+    // Small tolerance so a packet that ends exactly at teardown is not lost to rounding
+    return current_time_us + getTxTimeUs(packets.at(packet_id).size_bytes) <= circuit_down_us + 1e-9;
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::computeRotorLbGrants() {
+    int slot_capacity = getSlotCapacityPkts();
+    double slot_time = topology->getSlotTime();
+    std::vector<int> offered(config.num_racks);
+    std::vector<int> candidates;
+
+    for (int i = 0; i < config.num_racks; i++) {
+        VirtualOutputQueues& my_voq = rack_voqs.at(i);
+        std::vector<IndirectGrant>& grants = rotorlb_grants[i];
+
+        // Opera reconfigures one switch at a time: only uplinks whose circuit
+        // changed since their grants were computed take part in this round.
+        // Their unused credits are returned to the intermediates.
+        std::vector<char> regrant(config.num_switches, 0);
+        for (int s = 0; s < config.num_switches; s++) {
+            int uplink = getUplinkIndex(i, s);
+            double down = topology->getCircuitDownTime(s, current_time_us);
+            if (std::fabs(rotorlb_granted_until[uplink] - down) > 1e-6) {
+                rotorlb_granted_until[uplink] = down;
+                regrant[s] = 1;
+            }
+        }
+        std::fill(offered.begin(), offered.end(), 0);
+        size_t kept = 0;
+        for (const IndirectGrant& g : grants) {
+            if (regrant[g.switch_id]) {
+                for (int c = 0; c < g.credits; c++) {
+                    rack_voqs.at(g.via).releaseNonlocal(g.final_dst);
+                }
+            } else {
+                offered[g.final_dst] += g.credits;
+                grants[kept++] = g;
+            }
+        }
+        grants.resize(kept);
+
+        // Offer the local traffic that has no circuit now, longest VOQs first
+        candidates = my_voq.getNonemptyLocalDestinations();
+        std::stable_sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+            return my_voq.getLocalQueueSize(a) > my_voq.getLocalQueueSize(b);
+        });
+
+        for (int s = 0; s < config.num_switches; s++) {
+            if (!regrant[s]) continue;
+            int j = topology->getConnectedRack(i, s, current_time_us);
+            if (j < 0 || j == i) continue;
+            VirtualOutputQueues& via_voq = rack_voqs.at(j);
+            double circuit_down_us = rotorlb_granted_until[getUplinkIndex(i, s)];
+
+            // Spare capacity of this uplink for the rest of its circuit after
+            // direct traffic (second-hop first, then local)
+            int spare = getCircuitCapacityPkts(circuit_down_us) -
+                        static_cast<int>(my_voq.getNonlocalQueueSize(j) + my_voq.getLocalQueueSize(j));
+
+            for (int k : candidates) {
+                if (spare <= 0) break;
+                if (k == j || topology->hasDirectPath(i, k, current_time_us)) continue;
+                // j must reach k within one slot of this circuit tearing down
+                if (topology->getNextDirectPathTime(j, k, current_time_us) >= circuit_down_us + slot_time) continue;
+
+                int offer = static_cast<int>(my_voq.getLocalQueueSize(k)) - offered[k];
+                // Accept: j takes only what it has buffer for
+                int accept = 0;
+                while (accept < std::min(offer, spare) &&
+                       via_voq.hasNonlocalCredit(k) &&
+                       via_voq.getNonlocalQueueSize(k) + via_voq.getNonlocalReserved(k) <
+                           static_cast<size_t>(slot_capacity)) {
+                    via_voq.reserveNonlocal(k);
+                    accept++;
+                }
+                if (accept > 0) {
+                    grants.push_back({j, s, k, accept});
+                    offered[k] += accept;
+                    spare -= accept;
+                }
+            }
+        }
+    }
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::handleSlotBoundary() {
+    if constexpr (RoutingPolicy::kPerSlotIndirection) {
+        computeRotorLbGrants();
+    }
+
+    // Circuits just came up: uplinks that went idle waiting for a matching retry
+    for (int i = 0; i < config.num_racks; i++) {
+        rack_voqs.at(i).releaseTrainPackets(current_time_us, true);
+        if (rack_voqs.at(i).getTotalPackets() > 0) {
+            startTransmission(i);
+        }
     }
+    scheduleEvent(EventType::SLOT_BOUNDARY, topology->getNextCircuitUpTime(current_time_us), 0);
 }
 
 
-void Simulator::scheduleEvent(EventType type, double time, uint64_t id) {
+void SimulatorBase::scheduleEvent(EventType type, double time, uint64_t id) {
     Event e;
     e.type = type;
     e.time_us = time;
     e.id = id;
+#ifdef PROFILE
+    uint64_t start = readCycles();
+    event_queue.push(e);
+    profiler.addPush(readCycles() - start);
+#else
     event_queue.push(e);
+#endif
+}
+
+void SimulatorBase::popEvent() {
+#ifdef PROFILE
+    uint64_t start = readCycles();
+    event_queue.pop();
+    profiler.addPop(readCycles() - start);
+#else
+    event_queue.pop();
+#endif
+}
+
+void SimulatorBase::scheduleNextGeneratedFlow() {
+    Flow flow;
+    if (workload && workload->nextFlow(flow)) {
+        flows[flow.id] = flow;
+        scheduleEvent(EventType::FLOW_ARRIVAL, flow.start_time * 1000.0, flow.id); // Convert ms to us
+    }
+}
+
+void SimulatorBase::handleStatsSample() {
+    // Per-packet events at this time come first: count what they would have sent
+    advanceTrains(current_time_us);
+    int backlog = 0;
+    size_t max_voq = 0;
+    for (auto& pair : rack_voqs) {
+        pair.second.releaseTrainPackets(current_time_us, true);
+        backlog += pair.second.getTotalPackets();
+        max_voq = std::max(max_voq, pair.second.getMaxQueueSize());
+    }
+    
+    double window_s = config.sample_interval_ms / 1000.0;
+    TimeSeriesSample sample;
+    sample.time_ms = current_time_us / 1000.0;
+    sample.offered_gbps = window_offered_bytes * 8.0 / (window_s * 1e9);
+    sample.goodput_gbps = window_delivered_bytes * 8.0 / (window_s * 1e9);
+    sample.voq_backlog_pkts = backlog;
+    sample.max_voq_pkts = static_cast<int>(max_voq);
+    sample.drops = stats.getDroppedPackets() - window_start_drops;
+    stats.addSample(sample);
+    
+    window_offered_bytes = 0;
+    window_delivered_bytes = 0;
+    window_start_drops = stats.getDroppedPackets();
+    
+    scheduleEvent(EventType::STATS_SAMPLE, current_time_us + config.sample_interval_ms * 1000.0, 0);
+    
+    if (config.steady_state) {
+        checkSteadyState(sample);
+    }
 }
 
-void Simulator::handleFlowArrival(uint64_t flow_id) {
+void SimulatorBase::checkSteadyState(const TimeSeriesSample& sample) {
+    steady.addSample(sample.goodput_gbps, sample.voq_backlog_pkts);
+    if (config.steady_ci_target <= 0 || drain_start_us >= 0) return;
+    
+    long warmup_samples = steady.getWarmupSamples();
+    if (warmup_samples < 0) return;
+    
+    double warmup_ms = warmup_samples * config.sample_interval_ms;
+    std::vector<double> fcts;
+    for (const FlowRecord& record : finished_flows) {
+        if (record.start_time >= warmup_ms) fcts.push_back(record.fct);
+    }
+    if (fcts.empty()) return;
+    
+    // The flows still open are the long tail. Only flows that started at least
+    // the completed flows' p99 ago are evaluated: those of them still open have
+    // already run longer than that, so they count as right-censored above it.
+    auto p99_it = fcts.begin() + static_cast<size_t>(fcts.size() * 0.99);
+    std::nth_element(fcts.begin(), p99_it, fcts.end());
+    double cutoff_ms = current_time_us / 1000.0 - *p99_it;
+    fcts.clear();
+    for (const FlowRecord& record : finished_flows) {
+        if (record.start_time >= warmup_ms && record.start_time <= cutoff_ms) fcts.push_back(record.fct);
+    }
+    size_t censored = 0;
+    for (const auto& entry : flows) {
+        const Flow& flow = entry.second;
+        if (flow.start_time >= warmup_ms && flow.start_time <= cutoff_ms) censored++;
+    }
+    double half_width = SteadyStateDetector::getP99RelativeHalfWidth(fcts, censored);
+    if (half_width <= config.steady_ci_target) {
+        if (!config.quiet) {
+            std::cout << "Steady state: p99 FCT within +-" << half_width * 100 << "% after "
+                      << warmup_ms << " ms warm-up; stopping at " << current_time_us / 1000.0 << " ms" << std::endl;
+        }
+        end_time_us = current_time_us;
+        stopped_early = true;
+    }
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::handleFlowArrival(uint64_t flow_id) {
+    // Keep exactly one generated arrival pending in the event queue
+    scheduleNextGeneratedFlow();
+    
     Flow& flow = flows[flow_id];
+    window_offered_bytes += flow.size_bytes;
     
-    // Create packets for this flow
-    int num_packets = flow.getNumPackets(config.mtu_bytes);
-    uint64_t remaining_bytes = flow.size_bytes;
-    
-    // For 2-hop VLB: randomly select intermediate rack for this flow
-    std::uniform_int_distribution<int> rack_dist(0, config.num_racks - 1);
-    int intermediate = -1;
-    
-    // Use VLB for skewed traffic or when configured
-    // For simplicity: always use VLB for low-latency, probabilistic for bulk
-    if (flow.type == FlowType::LOW_LATENCY) {
-        // Always use 2-hop for low-latency
-        assert(false && "LOW_LATENCY not used in this config");
-        do {
-            intermediate = rack_dist(rng);
-        } while (intermediate == flow.src_rack || intermediate == flow.dst_rack);
-    } else {
-        // Bulk: try direct first, use VLB if needed (decision made per packet based on queue state)
-        intermediate = -1; // Will be set per-packet if needed
+    // Low-latency flows use the packet switch; without one they share the rotor
+    if (flow.type == FlowType::LOW_LATENCY && config.packet_switch_gbps <= 0 && !warned_low_latency) {
+        std::cerr << "Warning: LOW_LATENCY flows present but packet_switch_gbps is 0; "
+                  << "routing them over the rotor network" << std::endl;
+        warned_low_latency = true;
     }
     
+    // Hybrid: an elephant joins its direct VOQ as one fluid entry, behind and
+    // ahead of packets exactly as its packets would be. It counts as the packets
+    // it stands for, so packets behind it see as full a VOQ as they would.
+    // Without retransmission the packets that do not fit are dropped for good,
+    // as their per-packet enqueues would be; with it the whole flow is admitted
+    // (its charge capped at the capacity), as resends would deliver it.
+    if (config.hybrid_fluid_min_bytes > 0 && flow.type == FlowType::BULK &&
+        flow.size_bytes >= config.hybrid_fluid_min_bytes) {
+        VirtualOutputQueues& voq = rack_voqs.at(flow.src_rack);
+        voq.releaseTrainPackets(current_time_us, false);
+        int num_packets = flow.getNumPackets(config.mtu_bytes);
+        int admitted = num_packets;
+        if (!config.retransmit) {
+            size_t queued = voq.getLocalQueueSize(flow.dst_rack);
+            size_t room = queued < static_cast<size_t>(config.queue_size_pkts) ? config.queue_size_pkts - queued : 0;
+            admitted = static_cast<int>(std::min<size_t>(num_packets, room));
+            for (int i = admitted; i < num_packets; i++) {
+                stats.addDroppedPacket();
+            }
+        }
+        if (admitted == 0) {
+            flow.packets_sent = num_packets;
+            return;
+        }
+        uint64_t packet_id = createPacket(flow);
+        Packet& pkt = packets[packet_id];
+        pkt.fluid = true;
+        pkt.fluid_bytes = std::min<uint64_t>(flow.size_bytes, static_cast<uint64_t>(admitted) * config.mtu_bytes);
+        pkt.current_dst = flow.dst_rack;
+        flow.packets_sent = num_packets;
+        voq.enqueueFluid(packet_id, flow.dst_rack, getFluidChargePkts(pkt.fluid_bytes));
+        startTransmission(flow.src_rack);
+        return;
+    }
+    
+    // With host modelling the source NIC serializes the flow; packets are created as they are sent
+    if (config.model_hosts) {
+        int host = getHostIndex(flow.src_rack, flow.src_host);
+        host_nics[host].addFlow(flow_id);
+        if (!host_nics[host].isBusy()) {
+            startHostTransmission(host);
+        }
+        return;
+    }
+    
+    // Create packets for this flow
+    int num_packets = flow.getNumPackets(config.mtu_bytes);
     for (int i = 0; i < num_packets; i++) {
-        Packet pkt;
-        pkt.id = next_packet_id++;
-        pkt.flow_id = flow_id;
-        pkt.src_rack = flow.src_rack;
-        pkt.final_dst = flow.dst_rack;
-        // pkt.current_dst = flow.src_rack;
-        pkt.src_host = flow.src_host;
-        pkt.dst_host = flow.dst_host;
-        pkt.size_bytes = std::min((uint64_t)config.mtu_bytes, remaining_bytes);
-        pkt.creation_time = current_time_us / 1000.0; // Convert to ms
-        pkt.type = flow.type;
-        pkt.dropped = false;
-        pkt.hop_count = 0;
-        pkt.current_rack = flow.src_rack;
-        // Set randomly when we connect because we may have a direct connection insteda
-        // of 2Hop each time
-        // pkt.intermediate_rack = intermediate;
-        // pkt.at_intermediate = false;
-        
-        remaining_bytes -= pkt.size_bytes;
-        
-        flow.packet_ids.push_back(pkt.id);
-        packets[pkt.id] = pkt;
+        uint64_t packet_id = createPacket(flow);
         
         // Enqueue packet at source rack
-        enqueuePacket(pkt.id, flow.src_rack);
+        enqueuePacket(packet_id, flow.src_rack);
     }
 }
 
-void Simulator::startTransmission(int rack_id) {
-    // This rack's voqs
-    VirtualOutputQueues& myVoq = rack_voqs.at(rack_id);
-    std::vector<int> localDests = myVoq.getNonemptyLocalDestinations();
-    std::vector<int> nonLocalDests = myVoq.getNonemptyNonlocalDestinations();
+uint64_t SimulatorBase::createPacket(Flow& flow) {
+    Packet pkt;
+    pkt.id = next_packet_id++;
+    pkt.flow_id = flow.id;
+    pkt.seq = flow.packets_sent++;
+    pkt.src_rack = flow.src_rack;
+    pkt.final_dst = flow.dst_rack;
+    // pkt.current_dst = flow.src_rack;
+    pkt.src_host = flow.src_host;
+    pkt.dst_host = flow.dst_host;
+    pkt.size_bytes = std::min((uint64_t)config.mtu_bytes,
+                              flow.size_bytes - (uint64_t)pkt.seq * config.mtu_bytes);
+    pkt.creation_time = current_time_us / 1000.0; // Convert to ms
+    pkt.type = flow.type;
+    pkt.dropped = false;
+    pkt.hop_count = 0;
+    pkt.current_rack = flow.src_rack;
+    pkt.tx_switch = -1;
+    pkt.fluid = false;
+    pkt.fluid_bytes = 0;
+    pkt.fluid_chunk_bytes = 0;
+    // Set randomly when we connect because we may have a direct connection insteda
+    // of 2Hop each time
+    // pkt.intermediate_rack = intermediate;
+    // pkt.at_intermediate = false;
+    
+    packets[pkt.id] = pkt;
+    return pkt.id;
+}
+
+size_t SimulatorBase::getFluidChargePkts(uint64_t fluid_bytes) const {
+    uint64_t pkts = (fluid_bytes + config.mtu_bytes - 1) / config.mtu_bytes;
+    return static_cast<size_t>(std::max<uint64_t>(1, std::min<uint64_t>(pkts, config.queue_size_pkts)));
+}
+
+double SimulatorBase::getTxTimeUs(int size_bytes) const {
+    double bits = size_bytes * 8.0;
+    return bits / (config.link_rate_gbps * 1e9) * 1e6;
+}
+
+void SimulatorBase::startHostTransmission(int host) {
+    HostNic& nic = host_nics[host];
+    
+    // Lossless: the ToR has paused its hosts until its held packets are admitted
+    int rack = host / config.hosts_per_rack;
+    if (config.lossless && !rack_ingress[rack].held.empty()) {
+        if (!nic.isPaused()) {
+            nic.setPaused(true);
+            rack_ingress[rack].paused_nics.push_back(host);
+        }
+        nic.setBusy(false);
+        return;
+    }
     
-    if (localDests.empty() && nonLocalDests.empty()) {
-        rack_busy[rack_id] = false;
+    if (!nic.hasFlows() && !nic.hasRetransmissions()) {
+        nic.setBusy(false);
         return;
     }
+    nic.setBusy(true);
+    
+    uint64_t packet_id;
+    if (nic.hasRetransmissions()) {
+        // Retransmissions go ahead of new data
+        packet_id = nic.popRetransmission();
+    } else {
+        // Serialize the next packet of the round-robin flow
+        Flow& flow = flows[nic.currentFlow()];
+        packet_id = createPacket(flow);
+        nic.rotate(flow.packets_sent == flow.getNumPackets(config.mtu_bytes));
+    }
+    
+    scheduleEvent(EventType::HOST_TRANSMISSION_COMPLETE,
+                 current_time_us + getTxTimeUs(packets[packet_id].size_bytes), packet_id);
+}
+
+void SimulatorBase::handleHostTransmissionComplete(uint64_t packet_id) {
+    const Packet& pkt = packets[packet_id];
+    
+    // Packet reaches the source ToR after the host-ToR propagation delay
+    scheduleEvent(EventType::PACKET_ARRIVAL, current_time_us + config.propagation_delay_us, packet_id);
+    
+    startHostTransmission(getHostIndex(pkt.src_rack, pkt.src_host));
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::startTransmission(int rack_id) {
+    if (rack_voqs.at(rack_id).getTotalPackets() == 0) {
+        return;
+    }
+    for (int s = 0; s < config.num_switches; s++) {
+        if (!uplink_busy[getUplinkIndex(rack_id, s)]) {
+            startUplinkTransmission(rack_id, s);
+        }
+    }
+}
+
+template <class RoutingPolicy>
+bool Simulator<RoutingPolicy>::startUplinkTransmission(int rack_id, int switch_id) {
+    // The uplink can only carry traffic for the rack its switch currently connects to
+    int dest = topology->getConnectedRack(rack_id, switch_id, current_time_us);
+    if (dest < 0 || dest == rack_id) {
+        return false;
+    }
     
-    rack_busy[rack_id] = true;
-    int selected_dest = -1;
-    uint64_t packet_id = -1;    // filled in by VOQ::dequeue(dest, packet_id, voqType)
+    // This rack's voqs
+    VirtualOutputQueues& myVoq = rack_voqs.at(rack_id);
+    uint64_t packet_id = -1;    // filled in by VOQ::front(dest, packet_id, voqType)
     VoqType selected_type;
+    int selected_voq = -1;      // VOQ key: dest, or the final destination of a RotorLB grant
+    IndirectGrant* grant = nullptr;
+    
+    // Only packets that finish serializing before the circuit tears down may start;
+    // the rest wait for their next matching
+    double circuit_down_us = topology->getCircuitDownTime(switch_id, current_time_us);
+    bool deferred = false;
 
-    // Priority 1: Nonlocal packets with direct path (these are second hop traffic)
-    for (int dest : nonLocalDests)
+    // Priority 1: Nonlocal packets for the partner (these are second hop traffic)
+    if (myVoq.front(dest, packet_id, VoqType::NONLOCAL))
     {
-        if (topology.hasDirectPath(rack_id, dest, current_time_us))
-        {
-            if (myVoq.dequeue(dest, packet_id, VoqType::NONLOCAL))
-            {
-                selected_dest = dest;
-                selected_type = VoqType::NONLOCAL;
-                // ready to transmit
+        if (fitsInCircuit(packet_id, circuit_down_us)) {
+            selected_voq = dest;
+            selected_type = VoqType::NONLOCAL;
+        } else {
+            deferred = true;
+        }
+    }
+    // PRIORITY 2: Local packets for the partner (these are direct connections)
+    if (selected_voq < 0 && myVoq.front(dest, packet_id, VoqType::LOCAL))
+    {
+        if (packets[packet_id].fluid) {
+            if (startFluidChunk(rack_id, switch_id, packet_id, circuit_down_us, deferred)) {
+                return true;
             }
+        } else if (fitsInCircuit(packet_id, circuit_down_us)) {
+            selected_voq = dest;
+            selected_type = VoqType::LOCAL;
+        } else {
+            deferred = true;
         }
     }
-
-    if (selected_dest < 0)  // No second hop, direct traffic found
+    if (RoutingPolicy::kPerSlotIndirection && selected_voq < 0)
     {
-        // PRIORITY 2: Local packets with direct path (these are direct connections)
-        for (int dest : localDests)
+        // PRIORITY 3 (RotorLB): indirect traffic the partner accepted
+        for (IndirectGrant& g : rotorlb_grants[rack_id])
         {
-            if (topology.hasDirectPath(rack_id, dest, current_time_us))
-            {
-                if (myVoq.dequeue(dest, packet_id, VoqType::LOCAL))
-                {
-                    selected_dest = dest;
-                    selected_type = VoqType::LOCAL;
-                }
-                // ready to transmit
+            if (g.switch_id != switch_id || g.credits <= 0 ||
+                !myVoq.front(g.final_dst, packet_id, VoqType::LOCAL) || packets[packet_id].fluid) {
+                continue;
+            }
+            if (fitsInCircuit(packet_id, circuit_down_us)) {
+                selected_voq = g.final_dst;
+                selected_type = VoqType::LOCAL;
+                grant = &g;
+                break;
             }
+            deferred = true;
         }
     }
 
-    if (selected_dest < 0)  // Still no direct traffic found. 
+    if (selected_voq < 0)
     {
-        // We just re-enqueue and retry later. RotorNet buffers it
-        rack_busy[rack_id] = false;
+        // Nothing that fits for this partner. We just wait for the next matching; RotorNet
+        // buffers it. Count the rest of the circuit as lost to fragmentation once.
+        int uplink = getUplinkIndex(rack_id, switch_id);
+        if (deferred && uplink_deferred_until[uplink] != circuit_down_us) {
+            uplink_deferred_until[uplink] = circuit_down_us;
+            stats.addFragmentation((circuit_down_us - current_time_us) * config.link_rate_gbps * 1e3 / 8.0);
+        }
+        return false;
+    }
+
+    myVoq.dequeue(selected_voq, packet_id, selected_type);
+    if (grant) {
+        grant->credits--;
+        packets[packet_id].current_dst = dest;
+    }
+
+    uplink_busy[getUplinkIndex(rack_id, switch_id)] = 1;
+
+    Packet& pkt = packets[packet_id];
+    pkt.tx_switch = switch_id;
+    
+    // Calculate transmission time
+    double tx_time_us = getTxTimeUs(pkt.size_bytes);
+    
+    pkt.sent_time = current_time_us / 1000.0;
+    
+    // Packet train: keep pulling back-to-back packets from the same VOQ while they
+    // fit in the circuit. A packet relayed through an intermediate ends the train,
+    // since its arrival there must be scheduled as an event. No train forms while
+    // another circuit reaches the partner: per packet, both uplinks would draw
+    // from this VOQ in turn. Each packet after the first keeps its VOQ slot until
+    // its own start.
+    PacketTrain train{rack_id, switch_id, current_time_us,
+                      static_cast<uint64_t>(pkt.size_bytes), {packet_id}};
+    double train_end_us = current_time_us + tx_time_us;
+    bool relayed = pkt.current_dst != pkt.final_dst;
+    if (config.packet_train_max_pkts > 1 && hasParallelCircuit(rack_id, switch_id, dest, circuit_down_us)) {
+        relayed = true;
+    }
+    while (!relayed && static_cast<int>(train.packet_ids.size()) < config.packet_train_max_pkts &&
+           (!grant || grant->credits > 0) &&
+           myVoq.front(selected_voq, packet_id, selected_type)) {
+        Packet& next = packets[packet_id];
+        if (next.fluid) break;
+        double next_tx_us = getTxTimeUs(next.size_bytes);
+        if (train_end_us + next_tx_us > circuit_down_us + 1e-9) break;
+        
+        myVoq.dequeue(selected_voq, packet_id, selected_type);
+        myVoq.holdForTrain(selected_voq, selected_type, train_end_us);
+        if (grant) {
+            grant->credits--;
+            next.current_dst = dest;
+        }
+        next.tx_switch = switch_id;
+        relayed = next.current_dst != next.final_dst;
+        train.packet_ids.push_back(packet_id);
+        train.bytes += next.size_bytes;
+        train_end_us += next_tx_us;
+    }
+    
+    if (train.packet_ids.size() == 1) {
+        scheduleEvent(EventType::PACKET_TRANSMISSION_COMPLETE,
+                     current_time_us + tx_time_us, train.packet_ids.front());
+    } else {
+        uint64_t train_id = next_train_id++;
+        trains.emplace(train_id, std::move(train));
+        scheduleEvent(EventType::TRAIN_TRANSMISSION_COMPLETE, train_end_us, train_id);
+    }
+
+    // A LOCAL slot just freed up: admit packets held by backpressure, which may
+    // have traffic for the partners of other idle uplinks
+    if (config.lossless && selected_type == VoqType::LOCAL && !rack_ingress[rack_id].held.empty()) {
+        admitHeldPackets(rack_id);
+        startTransmission(rack_id);
+    }
+    return true;
+}
+
+void SimulatorBase::deliverPacket(uint64_t packet_id, double arrival_time_us) {
+    Packet& pkt = packets[packet_id];
+    
+    // Packet has reached its ultimate destination ToR; with host modelling it
+    // still has to be serialized on the ToR downlink to the destination host
+    if (config.model_hosts) {
+        arrival_time_us = host_downlinks[getHostIndex(pkt.final_dst, pkt.dst_host)]
+                              .serve(arrival_time_us, getTxTimeUs(pkt.size_bytes));
+    }
+    pkt.arrival_time = arrival_time_us / 1000.0;
+    total_bytes_transmitted += pkt.size_bytes;
+    window_delivered_bytes += pkt.size_bytes;
+    
+    // Update flow completion
+    Flow& flow = flows[pkt.flow_id];
+    flow.packets_received++;
+    flow.rto_backoff = 0;
+    // Trains deliver when they end, not in arrival order: the flow completes
+    // with its latest arrival, whichever packet is counted last
+    flow.completion_time = std::max(flow.completion_time, pkt.arrival_time);
+    
+    int distance = flow.reorder.receive(pkt.seq, flow.getNumPackets(config.mtu_bytes));
+    stats.addDelivery(distance, flow.reorder.occupancy);
+    
+    if (flow.packets_received == flow.getNumPackets(config.mtu_bytes)) {
+        completeFlow(flow, flow.completion_time);
+    }
+    packets.erase(packet_id);
+}
+
+void SimulatorBase::completeFlow(Flow& flow, double completion_time_ms) {
+    flow.completed = true;
+    flow.completion_time = completion_time_ms;
+    // A streamed FCT needs no record, unless the warm-up cut is still to be made
+    if (config.stream_fcts && !config.steady_state) {
+        stats.addCompletedFlow(flow.getFCT(), flow.type);
+    } else {
+        finished_flows.push_back({flow.id, flow.start_time, flow.getFCT(), flow.type});
+    }
+    flows.erase(flow.id);
+}
+
+void SimulatorBase::sendToPacketSwitch(uint64_t packet_id, int rack_id) {
+    Packet& pkt = packets[packet_id];
+    double departure_us;
+    if (!packet_switch.getUplink(rack_id).offer(current_time_us, getPacketSwitchTxTimeUs(pkt.size_bytes), departure_us)) {
+        stats.addPacketSwitchDrop();
+        dropPacket(packet_id);
         return;
     }
+    pkt.sent_time = current_time_us / 1000.0;
+    scheduleEvent(EventType::PACKET_SWITCH_ARRIVAL, departure_us + config.propagation_delay_us, packet_id);
+}
+
+void SimulatorBase::handlePacketSwitchArrival(uint64_t packet_id) {
+    Packet& pkt = packets[packet_id];
+    double departure_us;
+    if (!packet_switch.getDownlink(pkt.final_dst).offer(current_time_us, getPacketSwitchTxTimeUs(pkt.size_bytes), departure_us)) {
+        stats.addPacketSwitchDrop();
+        dropPacket(packet_id);
+        return;
+    }
+    scheduleEvent(EventType::PACKET_SWITCH_DEPARTURE, departure_us, packet_id);
+}
+
+void SimulatorBase::handlePacketSwitchDeparture(uint64_t packet_id) {
+    Packet& pkt = packets[packet_id];
+    pkt.hop_count = 1;
+    pkt.current_rack = pkt.final_dst;
+    deliverPacket(packet_id, current_time_us + config.propagation_delay_us);
+}
+
+double SimulatorBase::getPacketSwitchTxTimeUs(int size_bytes) const {
+    return size_bytes * 8.0 / (config.packet_switch_gbps * 1e3);
+}
 
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::handlePacketTransmissionComplete(uint64_t packet_id) {
     Packet& pkt = packets[packet_id];
+    int current_rack = pkt.current_rack;
+    int tx_switch = pkt.tx_switch;
+    
+    completeHop(packet_id, current_time_us);
     
-    // There should not be any low_latency flows
-    if (pkt.type == FlowType::LOW_LATENCY)
-        assert(false && "LOW_LATENCY not used in this config");
+    // Start next transmission on the uplink we just freed
+    uplink_busy[getUplinkIndex(current_rack, tx_switch)] = 0;
+    startUplinkTransmission(current_rack, tx_switch);
+}
 
+template <class RoutingPolicy>
+bool Simulator<RoutingPolicy>::startFluidChunk(int rack_id, int switch_id, uint64_t packet_id,
+                                               double circuit_down_us, bool& deferred) {
+    Packet& pkt = packets[packet_id];
+    if (pkt.fluid_chunk_bytes > 0) {
+        return false;  // Another uplink is draining it
+    }
     
-    // Calculate transmission time
-    double bits = pkt.size_bytes * 8.0;
-    double tx_time_us = bits / (config.link_rate_gbps * 1e9) * 1e6;
+    // Whole packets' worth of the remaining bytes that fit before teardown
+    double room_bytes = (circuit_down_us - current_time_us) * config.link_rate_gbps * 1e3 / 8.0 + 1e-6;
+    uint64_t chunk = pkt.fluid_bytes;
+    if (chunk > room_bytes) {
+        chunk = static_cast<uint64_t>(room_bytes / config.mtu_bytes) * config.mtu_bytes;
+    }
+    if (chunk == 0) {
+        deferred = true;
+        return false;
+    }
     
+    // The chunk's packets leave the VOQ as it starts; the last chunk takes the entry off
+    VirtualOutputQueues& voq = rack_voqs.at(rack_id);
+    size_t charged_pkts = getFluidChargePkts(pkt.fluid_bytes);
+    if (chunk == pkt.fluid_bytes) {
+        voq.shrinkFluid(pkt.current_dst, charged_pkts, 1);
+        voq.dequeue(pkt.current_dst, packet_id, VoqType::LOCAL);
+    } else {
+        voq.shrinkFluid(pkt.current_dst, charged_pkts, getFluidChargePkts(pkt.fluid_bytes - chunk));
+    }
+    uplink_busy[getUplinkIndex(rack_id, switch_id)] = 1;
+    pkt.tx_switch = switch_id;
+    pkt.fluid_chunk_bytes = chunk;
     pkt.sent_time = current_time_us / 1000.0;
+    scheduleEvent(EventType::FLUID_CHUNK_COMPLETE, current_time_us + chunk * 8.0 / (config.link_rate_gbps * 1e3), packet_id);
+    return true;
+}
+
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::handleFluidChunkComplete(uint64_t packet_id) {
+    Packet& pkt = packets[packet_id];
+    uint64_t chunk = pkt.fluid_chunk_bytes;
+    pkt.fluid_bytes -= chunk;
+    pkt.fluid_chunk_bytes = 0;
+    total_bytes_transmitted += chunk;
+    window_delivered_bytes += chunk;
+    
+    // Credit the flow with the packets the chunk stands for; only the final
+    // chunk can end in a partial packet
+    Flow& flow = flows[pkt.flow_id];
+    flow.packets_received += static_cast<int>((chunk + config.mtu_bytes - 1) / config.mtu_bytes);
+    int rack_id = pkt.current_rack;
+    int switch_id = pkt.tx_switch;
+    if (pkt.fluid_bytes == 0) {
+        // A flow whose excess packets were dropped on admission never completes
+        if (flow.packets_received == flow.getNumPackets(config.mtu_bytes)) {
+            completeFlow(flow, (current_time_us + config.propagation_delay_us) / 1000.0);
+        }
+        packets.erase(packet_id);
+    }
     
-    scheduleEvent(EventType::PACKET_TRANSMISSION_COMPLETE,
-                 current_time_us + tx_time_us, packet_id);
+    uplink_busy[getUplinkIndex(rack_id, switch_id)] = 0;
+    startUplinkTransmission(rack_id, switch_id);
 }
 
-void Simulator::handlePacketTransmissionComplete(uint64_t packet_id) {
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::handleTrainTransmissionComplete(uint64_t train_id) {
+    auto it = trains.find(train_id);
+    PacketTrain train = std::move(it->second);
+    trains.erase(it);
+    
+    // Reconstruct each packet's departure from the train start
+    double tx_end_us = train.start_us;
+    for (uint64_t packet_id : train.packet_ids) {
+        Packet& pkt = packets[packet_id];
+        pkt.sent_time = tx_end_us / 1000.0;
+        tx_end_us += getTxTimeUs(pkt.size_bytes);
+        completeHop(packet_id, tx_end_us);
+    }
+    
+    uplink_busy[getUplinkIndex(train.rack, train.switch_id)] = 0;
+    startUplinkTransmission(train.rack, train.switch_id);
+}
+
+bool SimulatorBase::hasParallelCircuit(int rack_id, int switch_id, int dest, double circuit_down_us) const {
+    for (int s = 0; s < config.num_switches; s++) {
+        if (s != switch_id && (topology->getConnectedRack(rack_id, s, current_time_us) == dest ||
+                               topology->getConnectedRack(rack_id, s, circuit_down_us) == dest)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SimulatorBase::advanceTrains(double time_us) {
+    for (auto& pair : trains) {
+        PacketTrain& train = pair.second;
+        size_t sent = 0;
+        while (sent < train.packet_ids.size()) {
+            Packet& pkt = packets[train.packet_ids[sent]];
+            double tx_end_us = train.start_us + getTxTimeUs(pkt.size_bytes);
+            if (tx_end_us > time_us) break;
+            pkt.sent_time = train.start_us / 1000.0;
+            train.bytes -= pkt.size_bytes;
+            train.start_us = tx_end_us;
+            completeHop(train.packet_ids[sent++], tx_end_us);
+        }
+        train.packet_ids.erase(train.packet_ids.begin(), train.packet_ids.begin() + sent);
+    }
+}
+
+void SimulatorBase::completeHop(uint64_t packet_id, double tx_end_us) {
     Packet& pkt = packets[packet_id];
-    int current_rack = pkt.current_rack;
     
     // Increment hop count BEFORE checking destination
     ++pkt.hop_count;
     
     // Add propagation delay
-    double arrival_time = current_time_us + config.propagation_delay_us;
+    double arrival_time = tx_end_us + config.propagation_delay_us;
     
     // Determine packet's next location based on current_dst
     int next_rack = pkt.current_dst;
@@ -281,18 +1574,7 @@ void Simulator::handlePacketTransmissionComplete(uint64_t packet_id) {
     // RECEIVE PATH LOGIC:
     // Case 1: Packet arrived at final destination
     if (next_rack == pkt.final_dst) {
-        // Packet has reached its ultimate destination
-        pkt.arrival_time = arrival_time / 1000.0;
-        total_bytes_transmitted += pkt.size_bytes;
-        
-        // Update flow completion
-        Flow& flow = flows[pkt.flow_id];
-        flow.packets_received++;
-        
-        if (flow.packets_received == flow.packet_ids.size()) {
-            flow.completed = true;
-            flow.completion_time = pkt.arrival_time;
-        }
+        deliverPacket(packet_id, arrival_time);
     }
     // Case 2: Packet arrived at intermediate rack (not final destination)
     else {
@@ -303,70 +1585,183 @@ void Simulator::handlePacketTransmissionComplete(uint64_t packet_id) {
         pkt.current_rack = next_rack;  // Update currentRack for next transmission
         
         // Schedule packet arrival at intermediate rack
-        // It will be enqueued in nonlocal VOQ there
-        if (arrival_time <= end_time_us)
-            scheduleEvent(EventType::PACKET_ARRIVAL, arrival_time, packet_id);
-        else
-            std::cout << "PacketId " << pkt.id << " from flow " << pkt.flow_id << " from srcRack " << pkt.src_rack 
-                << " to dstRack " << pkt.final_dst << "'s arrival time " << arrival_time << " at currentRack " 
-                << pkt.current_rack << " will exceed endtime " << end_time_us << "us. Not queuing arrival event"
-                << std::endl;
-    }
-    
-    // Start next transmission at the rack we just left
-    rack_next_free_time[current_rack] = current_time_us;
-    startTransmission(current_rack);
+        // It will be enqueued in nonlocal VOQ there (arrivals after the end are never processed)
+        scheduleEvent(EventType::PACKET_ARRIVAL, arrival_time, packet_id);
+    }
 }
 
-void Simulator::handlePacketArrival(uint64_t packet_id) {
+template <class RoutingPolicy>
+void Simulator<RoutingPolicy>::handlePacketArrival(uint64_t packet_id) {
     Packet& pkt = packets[packet_id];
     int current_rack = pkt.current_rack;
 
+    // Packet arrived at its source ToR from the host NIC
+    if (pkt.hop_count == 0)
+    {
+        enqueuePacket(packet_id, current_rack);
+        return;
+    }
+
     // Packet arrived at intermediate rack after first hop
     if (pkt.hop_count == 1 && current_rack != pkt.final_dst)
     {
         // Enqueu in NONLOCAL VOQ (This rack will forward it to 2nd hop (which should be final dst))
         pkt.current_dst = pkt.final_dst;
         VirtualOutputQueues& voq = rack_voqs.at(current_rack);
-        if (!voq.enqueue(packet_id, pkt.final_dst, VoqType::NONLOCAL))
+        voq.releaseTrainPackets(current_time_us, false);
+        if (config.lossless || RoutingPolicy::kPerSlotIndirection)
+        {
+            // Space was reserved when the source chose this intermediate
+            voq.enqueueReservedNonlocal(packet_id, pkt.final_dst);
+        }
+        else if (!voq.enqueue(packet_id, pkt.final_dst, VoqType::NONLOCAL))
         {
-            pkt.dropped = true;
-            stats.addDroppedPacket();
+            dropPacket(packet_id);
             return;
         }
     }
 
     // Start transmitting 
-    if (!rack_busy[current_rack])
-    {
-        startTransmission(current_rack);
+    startTransmission(current_rack);
+}
+
+template class Simulator<DirectRouting>;
+template class Simulator<VlbRouting>;
+template class Simulator<ThresholdRouting>;
+template class Simulator<PowerOfDRouting>;
+template class Simulator<RotorLbRouting>;
+
+Statistics runSimulation(const SimConfig& cfg, std::shared_ptr<const std::vector<Flow>> shared_flows) {
+    if (cfg.engine == SimEngine::FLUID) {
+        // Every policy would give the same fluid run
+        if (!cfg.compare_routing.empty() || shared_flows) {
+            throw std::runtime_error("compare_routing needs the packet engine; the fluid engine does not route");
+        }
+        if (cfg.checkpoint_time_ms >= 0 || !cfg.restore_file.empty() || cfg.steady_state) {
+            std::cerr << "Warning: checkpoints and steady-state detection are only supported "
+                      << "by the packet engine; ignoring" << std::endl;
+        }
+        if (cfg.drain_cap_ms > 0 || cfg.common_random_numbers) {
+            std::cerr << "Warning: drain_cap_ms and common_random_numbers are only supported "
+                      << "by the packet engine; ignoring" << std::endl;
+        }
+        if (cfg.routing != RoutingMode::DIRECT) {
+            std::cerr << "Warning: the fluid engine uses direct circuits only; ignoring routing "
+                      << routingModeName(cfg.routing) << std::endl;
+        }
+        FluidSimulator sim(cfg);
+        sim.run();
+        return sim.getStatistics();
     }
+    return dispatchRouting(cfg.routing, [&](auto tag) {
+        Simulator<typename decltype(tag)::type> sim(cfg);
+        sim.useSharedFlows(shared_flows);
+        sim.run();
+        return sim.getStatistics();
+    });
 }
 
-bool Simulator::shouldUseDirect(const Packet& pkt, int current_rack) 
-{
-    double direct_wait = topology.getNextDirectPathTime(
-        current_rack, pkt.final_dst, current_time_us) - current_time_us;
-    
-    // If direct path available very soon (< slot time), use it
-    if (direct_wait < config.getSlotTime()) {
-        return true;
+std::shared_ptr<const std::vector<Flow>> generateSharedFlows(const SimConfig& cfg) {
+    WorkloadGenerator wg(cfg);
+    if (!cfg.flow_file.empty()) {
+        return std::make_shared<const std::vector<Flow>>(wg.loadFlowsFromFile(cfg.flow_file));
     }
-    
-    // Check if direct queue is heavily loaded
-    size_t direct_queue = rack_voqs.at(current_rack).getLocalQueueSize(pkt.final_dst);
-    if (direct_queue > DIRECT_THRESHOLD) {
-        return false; // Too congested, try VLB
+    auto flow_list = std::make_shared<std::vector<Flow>>(wg.generateFlows(cfg.workload_threads));
+    if (cfg.save_flows) {
+        wg.saveFlowsToFile(*flow_list, cfg.flow_output_file);
     }
-    
-    return true; // Default to direct
+    return flow_list;
 }
 
-int Simulator::selectIntermediateRack(int src, int dst) {
-    std::uniform_int_distribution<int> dist(0, config.num_racks - 1);
-    int intermediate;
-    do {
-        intermediate = dist(rng);
-    } while (intermediate == src || intermediate == dst);
-    return intermediate;
+// Child side of runBranches: continue the prefix under variant with its routing policy
+static Statistics continueBranch(const SimConfig& variant, SimulatorBase&& prefix) {
+    return dispatchRouting(variant.routing, [&](auto tag) {
+        Simulator<typename decltype(tag)::type> sim(variant, std::move(prefix));
+        sim.finish();
+        return sim.getStatistics();
+    });
+}
+
+std::vector<Statistics> runBranches(const SimConfig& cfg, const std::vector<SimConfig>& variants) {
+    if (cfg.engine == SimEngine::FLUID || !cfg.restore_file.empty()) {
+        throw std::runtime_error("Branching needs the packet engine and a fresh run");
+    }
+    for (const SimConfig& variant : variants) {
+        checkBranchable(cfg, variant);
+        checkTrainable(variant);
+        checkHybrid(variant);
+    }
+    
+    return dispatchRouting(cfg.routing, [&](auto tag) {
+        Simulator<typename decltype(tag)::type> sim(cfg);
+        sim.startRun();
+        sim.runUntil(cfg.branch_time_ms * 1000.0);
+        if (!cfg.quiet) {
+            std::cout << "Branching " << variants.size() << " variants at "
+                      << sim.getCurrentTime() / 1000.0 << " ms" << std::endl;
+        }
+        std::fflush(stdout);
+        
+        std::vector<pid_t> children;
+        std::vector<int> result_pipes;
+        for (const SimConfig& variant : variants) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                throw std::runtime_error("pipe() failed while branching");
+            }
+            pid_t pid = fork();
+            if (pid < 0) {
+                throw std::runtime_error("fork() failed while branching");
+            }
+            if (pid == 0) {
+                // Child: continue quietly and send the statistics back in checkpoint format
+                close(fds[0]);
+                for (int fd : result_pipes) close(fd);
+                std::cout.setstate(std::ios::badbit);
+                int status = 0;
+                try {
+                    Statistics result = continueBranch(variant, std::move(sim));
+                    CheckpointWriter out;
+                    result.save(out);
+                    const std::vector<char>& bytes = out.bytes();
+                    for (size_t sent = 0; sent < bytes.size();) {
+                        ssize_t n = write(fds[1], bytes.data() + sent, bytes.size() - sent);
+                        if (n <= 0) throw std::runtime_error("write() to the parent failed");
+                        sent += static_cast<size_t>(n);
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Error in branch: " << e.what() << std::endl;
+                    status = 1;
+                }
+                close(fds[1]);
+                _exit(status);
+            }
+            close(fds[1]);
+            children.push_back(pid);
+            result_pipes.push_back(fds[0]);
+        }
+        
+        // The parent finishes the base config while the children run
+        sim.finish();
+        std::vector<Statistics> results = {sim.getStatistics()};
+        
+        for (size_t i = 0; i < children.size(); i++) {
+            std::vector<char> bytes;
+            char chunk[65536];
+            ssize_t n;
+            while ((n = read(result_pipes[i], chunk, sizeof(chunk))) > 0) {
+                bytes.insert(bytes.end(), chunk, chunk + n);
+            }
+            close(result_pipes[i]);
+            int status = 0;
+            waitpid(children[i], &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                throw std::runtime_error("Branch variant " + std::to_string(i + 1) + " failed");
+            }
+            CheckpointReader in(bytes, "branch variant " + std::to_string(i + 1));
+            results.emplace_back();
+            results.back().load(in);
+        }
+        return results;
+    });
 }
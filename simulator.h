@@ -3,9 +3,9 @@
 #define SIMULATOR_H
 
 #include <queue>
+#include <deque>
 #include <map>
 #include <memory>
-#include <random>
 #include <assert.h>
 #include "config.h"
 #include "flow.h"
@@ -13,14 +13,37 @@
 #include "workload_generator.h"
 #include "stats.h"
 #include "voq.h"
+#include "host.h"
+#include "packet_switch.h"
+#include "rng.h"
+#include "routing.h"
+#include "steady_state.h"
+#include "checkpoint.h"
+#ifdef PROFILE
+#include "profiler.h"
+#endif
 
 // Event types for discrete event simulation
 enum class EventType {
     FLOW_ARRIVAL,
     PACKET_ARRIVAL,
-    PACKET_TRANSMISSION_COMPLETE
+    PACKET_TRANSMISSION_COMPLETE,
+    TRAIN_TRANSMISSION_COMPLETE, // Last packet of a packet train leaves its uplink (ordered like a packet's)
+    STATS_SAMPLE,
+    HOST_TRANSMISSION_COMPLETE,
+    SLOT_BOUNDARY,
+    RETRANSMIT_TIMEOUT,
+    PACKET_SWITCH_ARRIVAL,      // Packet reaches the packet switch from its source ToR
+    PACKET_SWITCH_DEPARTURE,    // Packet leaves the packet switch for its destination ToR
+    FLUID_CHUNK_COMPLETE        // Chunk of a hybrid-mode fluid entry leaves its uplink
 };
 
+inline std::vector<std::string> eventTypeNames() {
+    return {"FLOW_ARRIVAL", "PACKET_ARRIVAL", "PACKET_TRANSMISSION_COMPLETE", "TRAIN_TRANSMISSION_COMPLETE",
+            "STATS_SAMPLE", "HOST_TRANSMISSION_COMPLETE", "SLOT_BOUNDARY", "RETRANSMIT_TIMEOUT",
+            "PACKET_SWITCH_ARRIVAL", "PACKET_SWITCH_DEPARTURE", "FLUID_CHUNK_COMPLETE"};
+}
+
 using VoqType = VirtualOutputQueues::VoqType;
 
 struct Event {
@@ -28,23 +51,72 @@ struct Event {
     double time_us;
     uint64_t id; // Flow or packet ID
     
+    // Ties are broken by (type, id) so the processing order does not depend on
+    // the order events were pushed (e.g. lazy vs. pre-generated arrivals)
     bool operator>(const Event& other) const {
-        return time_us > other.time_us;
+        if (time_us != other.time_us) return time_us > other.time_us;
+        if (type != other.type) return type > other.type;
+        return id > other.id;
     }
 };
 
-class Simulator {
-private:
+// Lossless-mode source state of a rack. Packets the ToR could not admit are held
+// (in arrival order) instead of dropped; while any are held the rack is paused
+// and its host NICs stop sending.
+struct RackIngress {
+    std::deque<uint64_t> held;
+    std::vector<int> paused_nics;
+    double pause_start_us = 0.0;
+    double paused_us = 0.0;
+};
+
+// Back-to-back packets one uplink sends from a single VOQ (packet_train_max_pkts).
+// Only the train's end is an event; each packet's departure time follows
+// arithmetically from start_us and the sizes of the packets ahead of it.
+// Packets that have left by a stats sample are delivered then and drop off the
+// front, so start_us is the start of the first packet still on the uplink.
+struct PacketTrain {
+    int rack;
+    int switch_id;
+    double start_us;
+    uint64_t bytes;
+    std::vector<uint64_t> packet_ids;
+};
+
+// RotorLB: credits rack `via` granted for the current circuit on switch_id for
+// relaying local traffic to final_dst
+struct IndirectGrant {
+    int via;
+    int switch_id;
+    int final_dst;
+    int credits;
+};
+
+// Routing-independent simulator state and helpers. Routing policies (routing.h)
+// read it through the public accessors; the event handlers that consult a policy
+// live in Simulator<RoutingPolicy> below.
+class SimulatorBase {
+protected:
     const SimConfig& config;
-    RotorTopology topology;
+    std::unique_ptr<Topology> topology;
     Statistics stats;
-    std::mt19937 rng;
-    int DIRECT_THRESHOLD;
+    PhiloxRng rng;
+    static constexpr int MAX_RTO_BACKOFF = 6;
     
     std::priority_queue<Event, std::vector<Event>, std::greater<Event>> event_queue;
     
+    // Live state only: a packet is erased once delivered (or dropped for good) and
+    // a flow once it completes, leaving a FlowRecord in finished_flows
     std::map<uint64_t, Flow> flows;
     std::map<uint64_t, Packet> packets;
+    std::vector<FlowRecord> finished_flows;     // In completion order
+    std::map<uint64_t, PacketTrain> trains;
+    uint64_t next_train_id;
+    
+    // Generated workloads are pulled one arrival at a time (null when loaded from file)
+    std::unique_ptr<WorkloadGenerator> workload;
+    // Immutable flow list shared by the runs of a sweep (common_random_numbers), else null
+    std::shared_ptr<const std::vector<Flow>> shared_flows;
     
     double current_time_us;
     double end_time_us;
@@ -52,29 +124,183 @@ private:
     
     // VOQ at each rack
     std::map<int, VirtualOutputQueues> rack_voqs;
-    std::map<int, bool> rack_busy; // Is rack currently transmitting?
-    std::map<int, double> rack_next_free_time;
+    
+    // Rack uplinks, one per rotor switch, indexed by rack * num_switches + switch.
+    // Each transmits independently to the rack currently matched on its switch.
+    std::vector<char> uplink_busy;
+    // Circuit (by teardown time) on which each uplink last deferred a packet that did not fit
+    std::vector<double> uplink_deferred_until;
+    
+    double slot_budget_bytes;  // Bytes one circuit carries while up during a slot
+    
+    // Host NICs and ToR downlinks, indexed by rack * hosts_per_rack + host (model_hosts only)
+    std::vector<HostNic> host_nics;
+    std::vector<HostDownlink> host_downlinks;
+    
+    std::vector<RackIngress> rack_ingress;
+    
+    // Packet-switched network for LOW_LATENCY flows (packet_switch_gbps > 0)
+    PacketSwitch packet_switch;
+    bool warned_low_latency;
+    
+    // RotorLB grants held by each rack for its current circuits
+    std::vector<std::vector<IndirectGrant>> rotorlb_grants;
+    // Circuit (by teardown time) each uplink's RotorLB grants were computed for
+    std::vector<double> rotorlb_granted_until;
     
     uint64_t total_bytes_transmitted;
     
+    // Time series window accumulators (sample_interval_ms)
+    uint64_t window_offered_bytes;
+    uint64_t window_delivered_bytes;
+    int window_start_drops;
+    
+    SteadyStateDetector steady;
+    bool stopped_early;         // steady_ci_target reached before sim_time_ms
+    double drain_start_us;      // End of the arrival window when draining (drain_cap_ms), else -1
+    
+    // Run loop bookkeeping
+    uint64_t event_count;
+    double progress_step_us;
+    double next_progress_us;
+    bool checkpoint_pending;
+    
+#ifdef PROFILE
+    EventProfiler profiler = EventProfiler(eventTypeNames());
+#endif
+    
     void scheduleEvent(EventType type, double time, uint64_t id);
+    void popEvent();
+    uint64_t createPacket(Flow& flow);
+    double getTxTimeUs(int size_bytes) const;
+    /// Packets a fluid entry with fluid_bytes left is charged as in its VOQ:
+    /// ceil(fluid_bytes / mtu), at most the VOQ capacity
+    size_t getFluidChargePkts(uint64_t fluid_bytes) const;
+    int getHostIndex(int rack, int host) const { return rack * config.hosts_per_rack + host; }
+    int getUplinkIndex(int rack, int switch_id) const { return rack * config.num_switches + switch_id; }
+    void startHostTransmission(int host);
+    void handleHostTransmissionComplete(uint64_t packet_id);
+    void scheduleNextGeneratedFlow();
+    void handleStatsSample();
+    /// Feeds a sample to the warm-up detector and, once warm, stops the run when
+    /// the p99 FCT confidence interval is narrow enough
+    void checkSteadyState(const TimeSeriesSample& sample);
+    /// Marks a packet dropped; with retransmit enabled, records it as lost and
+    /// arms the flow's retransmission timer, otherwise frees it
+    void dropPacket(uint64_t packet_id);
+    double getRtoUs() const;
+    void holdPacket(uint64_t packet_id, int rack_id);
+    /// Packets one circuit carries while up during a slot
+    int getSlotCapacityPkts() const;
+    /// Packets a circuit still carries from now until it tears down at circuit_down_us
+    int getCircuitCapacityPkts(double circuit_down_us) const;
+    /// True if the packet finishes serializing before the circuit tears down at circuit_down_us
+    bool fitsInCircuit(uint64_t packet_id, double circuit_down_us) const;
+    /// Final-destination ToR receive path: host downlink, flow completion, reordering
+    void deliverPacket(uint64_t packet_id, double arrival_time_us);
+    /// Packet fully left its uplink at tx_end_us: deliver it or forward it to its intermediate
+    void completeHop(uint64_t packet_id, double tx_end_us);
+    /// True if a circuit other than switch_id's connects rack_id to dest now or
+    /// before circuit_down_us (every circuit is up equally long per slot)
+    bool hasParallelCircuit(int rack_id, int switch_id, int dest, double circuit_down_us) const;
+    /// Completes the hops of train packets that have left their uplink by time_us,
+    /// as per-packet events would have before a sample or the end of the run
+    void advanceTrains(double time_us);
+    /// Records the completed flow in finished_flows and frees its state; flow is
+    /// dangling afterwards
+    void completeFlow(Flow& flow, double completion_time_ms);
+    void sendToPacketSwitch(uint64_t packet_id, int rack_id);
+    void handlePacketSwitchArrival(uint64_t packet_id);
+    void handlePacketSwitchDeparture(uint64_t packet_id);
+    double getPacketSwitchTxTimeUs(int size_bytes) const;
+    /// Writes the complete run state to filename; only valid between events
+    void saveCheckpoint(const std::string& filename) const;
+    /// Replaces the freshly constructed state with a checkpoint. Topology and
+    /// routing are rebuilt from the config, which must match its shape.
+    void loadCheckpoint(const std::string& filename);
+    /// Sets end_time_us and the progress/checkpoint bookkeeping from the config
+    void resetRunClock();
+    /// True if nothing is queued, held, in flight or on a timer anywhere
+    bool isNetworkIdle() const;
+    void collectStatistics();
+
+public:
+    SimulatorBase(const SimConfig& cfg);
+    /// Takes over the state of a run stopped part way, continuing it under cfg
+    /// (a branch variant with the same network shape)
+    SimulatorBase(const SimConfig& cfg, SimulatorBase&& prefix);
+    
+    /// Takes arrivals from flow_list instead of loading or generating them (call before startRun)
+    void useSharedFlows(std::shared_ptr<const std::vector<Flow>> flow_list) { shared_flows = std::move(flow_list); }
+    /// Loads or generates the workload (or restores a checkpoint) and schedules the first events
+    void startRun();
+    
+    Statistics getStatistics() const;
+    
+    // Read access for routing policies
+    const SimConfig& getConfig() const { return config; }
+    const Topology& getTopology() const { return *topology; }
+    const VirtualOutputQueues& getVoqs(int rack) const { return rack_voqs.at(rack); }
+    double getCurrentTime() const { return current_time_us; }
+};
+
+// Discrete-event engine. The routing policy is a template parameter so its
+// direct-vs-two-hop decisions inline into the packet path (no virtual dispatch);
+// simulator.cpp instantiates one engine per policy in routing.h.
+template <class RoutingPolicy>
+class Simulator : public SimulatorBase {
+private:
+    RoutingPolicy routing;
+    
+    void processEvent(const Event& evt);
+    /// After the arrival window: runs until every started flow has finished, the
+    /// network is idle or drain_cap_ms has passed
+    void drain();
     void handleFlowArrival(uint64_t flow_id);
     void enqueuePacket(uint64_t packet_id, int current_rack);
+    /// Routes a first-hop packet (direct or VLB) into the source VOQs.
+    /// Returns false if the chosen VOQ is full.
+    bool tryEnqueueAtSource(uint64_t packet_id, int current_rack);
+    int selectPath(const Packet& pkt, int current_rack);  // Flow::PATH_DIRECT or an intermediate
+    void handleRetransmitTimeout(uint64_t flow_id);
+    void admitHeldPackets(int rack_id);
+    void handleSlotBoundary();
+    /// RotorLB offer/accept round over the circuits that came up since the last round
+    void computeRotorLbGrants();
+    /// Starts a packet on every idle uplink of rack_id that has traffic for its partner
     void startTransmission(int rack_id);
+    /// Sends the next packet over rack_id's circuit on switch_id; false leaves the uplink idle
+    bool startUplinkTransmission(int rack_id, int switch_id);
+    /// Sends as much of a fluid entry as fits in the circuit as one chunk. Returns
+    /// false if none fits (deferred) or a chunk is already in flight.
+    bool startFluidChunk(int rack_id, int switch_id, uint64_t packet_id, double circuit_down_us, bool& deferred);
+    void handleFluidChunkComplete(uint64_t packet_id);
     void handlePacketTransmissionComplete(uint64_t packet_id);
+    void handleTrainTransmissionComplete(uint64_t train_id);
     void handlePacketArrival(uint64_t packet_id);
-    /// Gets whether this packet at current rack should try direct connection
-    /// based on Rotor Principle of if waitTime < slotTime. Defaults to true.
-    /// returns false if localQueueSize > DIRECT_THRESHOLD
-    bool shouldUseDirect(const Packet& pkt, int current_rack);
-    int selectIntermediateRack(int src, int dst);
 
 public:
     Simulator(const SimConfig& cfg);
+    Simulator(const SimConfig& cfg, SimulatorBase&& prefix);
     
     void run();
-    
-    Statistics getStatistics() const;
+    /// Processes events up to and including time_us (run() phases, for runBranches)
+    void runUntil(double time_us);
+    /// Runs the remaining events to sim_time_ms (then drains, if enabled) and collects statistics
+    void finish();
 };
 
+// Run one simulation with the engine and routing policy selected by cfg. With
+// shared_flows the packet engine takes its arrivals from that list.
+Statistics runSimulation(const SimConfig& cfg, std::shared_ptr<const std::vector<Flow>> shared_flows = nullptr);
+
+// Load (flow_file) or generate cfg's whole workload once, for the runs of a
+// common-random-numbers sweep to share
+std::shared_ptr<const std::vector<Flow>> generateSharedFlows(const SimConfig& cfg);
+
+// Run cfg to branch_time_ms, then fork() one child per variant that continues from
+// the parent's copy-on-write memory image. The parent finishes cfg itself; the
+// result is cfg's statistics followed by each variant's, collected through pipes.
+std::vector<Statistics> runBranches(const SimConfig& cfg, const std::vector<SimConfig>& variants);
+
 #endif // SIMULATOR_H
@@ -7,7 +7,20 @@
 #include <numeric>
 #include <fstream>
 #include <iomanip>
+#include <string>
 #include "flow.h"
+#include "checkpoint.h"
+#include "quantile_sketch.h"
+
+// One window of the sampled time series (sample_interval_ms)
+struct TimeSeriesSample {
+    double time_ms;          // end of window
+    double offered_gbps;     // bytes of flows arriving in the window
+    double goodput_gbps;     // bytes delivered to final destinations in the window
+    int voq_backlog_pkts;    // packets in all VOQs at all racks
+    int max_voq_pkts;        // deepest single VOQ
+    int drops;               // packets dropped in the window
+};
 
 class Statistics {
 private:
@@ -15,30 +28,139 @@ private:
     std::vector<double> fcts_low_latency;
     std::vector<double> all_fcts;
     
+    // Streaming mode (streamFctsToSketch): completed FCTs go into a sketch and a
+    // running sum instead of the lists above, so memory does not grow with the run
+    bool fct_streaming;
+    QuantileSketch fct_sketch;
+    double fct_sum;
+    
     int total_flows;
     int completed_flows;
     int dropped_packets;
+    int retransmitted_packets;
+    int packet_switch_drops;
     double total_throughput_gbps;
+    
+    // Slot fragmentation: circuits whose remaining up time was too short for the next packet
+    uint64_t deferred_transmissions;
+    double fragmentation_lost_bytes;
+    double circuit_capacity_bytes;
     double sim_time_ms;
+    
+    std::vector<TimeSeriesSample> time_series;
+    std::vector<double> rack_paused_ms;   // lossless mode only
+    
+    // Receiver reordering
+    uint64_t delivered_packets;
+    uint64_t reordered_packets;
+    int max_reorder_distance;
+    int max_reorder_occupancy;
+    // reorder_occupancy_hist[0] counts occupancy 0, [k] counts [2^(k-1), 2^k)
+    std::vector<uint64_t> reorder_occupancy_hist;
+    
+    // Steady-state detection (steady_state): trimmed warm-up and early stop time (-1 = none)
+    bool steady_detection;
+    double warmup_ms;
+    int warmup_flows;
+    double early_stop_ms;
+    
+    // Drain phase (drain_cap_ms): its length and the age (ms since start) of each
+    // flow still unfinished at its end, whose FCT is only known to exceed that age
+    bool drain_mode;
+    double drain_ms;
+    std::vector<double> censored_ages_ms;
 
 public:
-    Statistics() : total_flows(0), completed_flows(0), 
-                   dropped_packets(0), total_throughput_gbps(0),
-                   sim_time_ms(0) {}
+    Statistics() : fct_streaming(false), fct_sum(0), total_flows(0), completed_flows(0), 
+                   dropped_packets(0), retransmitted_packets(0), packet_switch_drops(0), total_throughput_gbps(0),
+                   deferred_transmissions(0), fragmentation_lost_bytes(0), circuit_capacity_bytes(0),
+                   sim_time_ms(0), delivered_packets(0), reordered_packets(0),
+                   max_reorder_distance(0), max_reorder_occupancy(0),
+                   steady_detection(false), warmup_ms(-1.0), warmup_flows(0), early_stop_ms(-1.0),
+                   drain_mode(false), drain_ms(0) {}
+    
+    void save(CheckpointWriter& out) const {
+        out.putVector(fcts_bulk);
+        out.putVector(fcts_low_latency);
+        out.putVector(all_fcts);
+        out.put<int32_t>(total_flows);
+        out.put<int32_t>(completed_flows);
+        out.put<int32_t>(dropped_packets);
+        out.put<int32_t>(retransmitted_packets);
+        out.put<int32_t>(packet_switch_drops);
+        out.put(total_throughput_gbps);
+        out.put(deferred_transmissions);
+        out.put(fragmentation_lost_bytes);
+        out.put(circuit_capacity_bytes);
+        out.put(sim_time_ms);
+        out.putVector(time_series);
+        out.putVector(rack_paused_ms);
+        out.put(delivered_packets);
+        out.put(reordered_packets);
+        out.put<int32_t>(max_reorder_distance);
+        out.put<int32_t>(max_reorder_occupancy);
+        out.putVector(reorder_occupancy_hist);
+        out.put<uint8_t>(steady_detection);
+        out.put(warmup_ms);
+        out.put<int32_t>(warmup_flows);
+        out.put(early_stop_ms);
+        out.put<uint8_t>(drain_mode);
+        out.put(drain_ms);
+        out.putVector(censored_ages_ms);
+    }
+    
+    void load(CheckpointReader& in) {
+        in.getVector(fcts_bulk);
+        in.getVector(fcts_low_latency);
+        in.getVector(all_fcts);
+        total_flows = in.get<int32_t>();
+        completed_flows = in.get<int32_t>();
+        dropped_packets = in.get<int32_t>();
+        retransmitted_packets = in.get<int32_t>();
+        packet_switch_drops = in.get<int32_t>();
+        in.get(total_throughput_gbps);
+        in.get(deferred_transmissions);
+        in.get(fragmentation_lost_bytes);
+        in.get(circuit_capacity_bytes);
+        in.get(sim_time_ms);
+        in.getVector(time_series);
+        in.getVector(rack_paused_ms);
+        in.get(delivered_packets);
+        in.get(reordered_packets);
+        max_reorder_distance = in.get<int32_t>();
+        max_reorder_occupancy = in.get<int32_t>();
+        in.getVector(reorder_occupancy_hist);
+        steady_detection = in.get<uint8_t>();
+        in.get(warmup_ms);
+        warmup_flows = in.get<int32_t>();
+        in.get(early_stop_ms);
+        drain_mode = in.get<uint8_t>();
+        in.get(drain_ms);
+        in.getVector(censored_ages_ms);
+    }
     
     void addFlow(const Flow& flow) {
+        if (flow.completed) {
+            addCompletedFlow(flow.getFCT(), flow.type);
+        } else {
+            total_flows++;
+        }
+    }
+    
+    void addCompletedFlow(double fct, FlowType type) {
         total_flows++;
+        completed_flows++;
+        if (fct_streaming) {
+            fct_sketch.add(fct);
+            fct_sum += fct;
+            return;
+        }
+        all_fcts.push_back(fct);
         
-        if (flow.completed) {
-            completed_flows++;
-            double fct = flow.getFCT();
-            all_fcts.push_back(fct);
-            
-            if (flow.type == FlowType::BULK) {
-                fcts_bulk.push_back(fct);
-            } else {
-                fcts_low_latency.push_back(fct);
-            }
+        if (type == FlowType::BULK) {
+            fcts_bulk.push_back(fct);
+        } else {
+            fcts_low_latency.push_back(fct);
         }
     }
     
@@ -46,6 +168,42 @@ public:
         dropped_packets++;
     }
     
+    void addRetransmittedPacket() {
+        retransmitted_packets++;
+    }
+    
+    // Drop in the packet-switched network (also counted in dropped_packets)
+    void addPacketSwitchDrop() {
+        packet_switch_drops++;
+    }
+    
+    // An uplink left idle for the rest of its circuit because the next packet did not fit
+    void addFragmentation(double lost_bytes) {
+        deferred_transmissions++;
+        fragmentation_lost_bytes += lost_bytes;
+    }
+    
+    // Total bytes all circuits could carry over the run (fragmentation denominator)
+    void setCircuitCapacityBytes(double bytes) {
+        circuit_capacity_bytes = bytes;
+    }
+    
+    // One packet delivered to its receiver: its reorder distance and the
+    // receiver's reorder buffer occupancy after it was placed
+    void addDelivery(int reorder_distance, int occupancy) {
+        delivered_packets++;
+        if (reorder_distance > 0) {
+            reordered_packets++;
+            max_reorder_distance = std::max(max_reorder_distance, reorder_distance);
+        }
+        max_reorder_occupancy = std::max(max_reorder_occupancy, occupancy);
+        
+        size_t bucket = 0;
+        while (occupancy >> bucket) bucket++;
+        if (bucket >= reorder_occupancy_hist.size()) reorder_occupancy_hist.resize(bucket + 1, 0);
+        reorder_occupancy_hist[bucket]++;
+    }
+    
     void setTotalThroughput(double gbps) {
         total_throughput_gbps = gbps;
     }
@@ -54,6 +212,90 @@ public:
         sim_time_ms = ms;
     }
     
+    // Warm-up trimmed from the FCT statistics (-1 if steady state was never
+    // reached) and the time the run stopped on a converged p99 (-1 if it did not)
+    void setSteadyState(double warmup, int excluded_flows, double stop_ms) {
+        steady_detection = true;
+        warmup_ms = warmup;
+        warmup_flows = excluded_flows;
+        early_stop_ms = stop_ms;
+    }
+    
+    // Drain after the arrival window and the flows it left unfinished
+    void setDrain(double drained_ms, const std::vector<double>& ages_ms) {
+        drain_mode = true;
+        drain_ms = drained_ms;
+        censored_ages_ms = ages_ms;
+    }
+    
+    int getDroppedPackets() const {
+        return dropped_packets;
+    }
+    
+    int getTotalFlows() const { return total_flows; }
+    int getCompletedFlows() const { return completed_flows; }
+    double getThroughputGbps() const { return total_throughput_gbps; }
+    double getDrainMs() const { return drain_ms; }
+    size_t getCensoredFlows() const { return censored_ages_ms.size(); }
+    // From here on, keep completed FCTs only as a sketch (and their sum for the
+    // mean); the FCTs recorded so far move into it. Per-type FCT statistics are
+    // no longer reported, and checkpoints do not carry the sketch.
+    void streamFctsToSketch() {
+        fct_streaming = true;
+        for (double fct : all_fcts) {
+            fct_sketch.add(fct);
+            fct_sum += fct;
+        }
+        std::vector<double>().swap(all_fcts);
+        std::vector<double>().swap(fcts_bulk);
+        std::vector<double>().swap(fcts_low_latency);
+    }
+    
+    double getMeanFct() const {
+        if (fct_streaming) return completed_flows ? fct_sum / completed_flows : 0.0;
+        return getMean(all_fcts);
+    }
+    double getFctPercentile(double percentile) const {
+        if (fct_streaming) return fct_sketch.quantile(percentile);
+        return getPercentile(all_fcts, percentile);
+    }
+    // Sketch of the completed FCTs (streaming mode only)
+    const QuantileSketch& getFctSketch() const { return fct_sketch; }
+    
+    void setRackPausedTimes(const std::vector<double>& paused_ms) {
+        rack_paused_ms = paused_ms;
+    }
+    
+    void addSample(const TimeSeriesSample& sample) {
+        time_series.push_back(sample);
+    }
+    const std::vector<TimeSeriesSample>& getTimeSeries() const { return time_series; }
+    
+    // Drain time: from peak backlog until the backlog first falls to 10% of the peak.
+    // Returns -1 if the backlog never drained within the run.
+    double getDrainTimeMs(size_t& peak_idx) const {
+        peak_idx = 0;
+        for (size_t i = 1; i < time_series.size(); i++) {
+            if (time_series[i].voq_backlog_pkts > time_series[peak_idx].voq_backlog_pkts) {
+                peak_idx = i;
+            }
+        }
+        int peak = time_series[peak_idx].voq_backlog_pkts;
+        for (size_t i = peak_idx; i < time_series.size(); i++) {
+            if (time_series[i].voq_backlog_pkts <= peak / 10) {
+                return time_series[i].time_ms - time_series[peak_idx].time_ms;
+            }
+        }
+        return -1.0;
+    }
+    
+    // "0", "1", "2-3", "4-7", ... for reorder_occupancy_hist bucket k
+    static std::string occupancyBucketName(size_t k) {
+        if (k == 0) return "0";
+        if (k == 1) return "1";
+        return std::to_string(1ULL << (k - 1)) + "-" + std::to_string((1ULL << k) - 1);
+    }
+    
     double getPercentile(const std::vector<double>& data, double percentile) const {
         if (data.empty()) return 0.0;
         
@@ -80,6 +322,9 @@ public:
         std::cout << "  Completed flows: " << completed_flows 
                   << " (" << (100.0 * completed_flows / total_flows) << "%)" << std::endl;
         std::cout << "  Dropped packets: " << dropped_packets << std::endl;
+        if (retransmitted_packets > 0) {
+            std::cout << "  Retransmitted packets: " << retransmitted_packets << std::endl;
+        }
         
         if (!all_fcts.empty()) {
             std::cout << "\nFlow Completion Times (all flows):" << std::endl;
@@ -93,6 +338,7 @@ public:
         if (!fcts_low_latency.empty()) {
             std::cout << "\nLow-latency FCTs:" << std::endl;
             std::cout << "  Count: " << fcts_low_latency.size() << std::endl;
+            std::cout << "  Packet switch drops: " << packet_switch_drops << std::endl;
             std::cout << "  Mean: " << getMean(fcts_low_latency) << " ms" << std::endl;
             std::cout << "  99th: " << getPercentile(fcts_low_latency, 0.99) << " ms" << std::endl;
         }
@@ -107,6 +353,71 @@ public:
         std::cout << "\nThroughput:" << std::endl;
         std::cout << "  Average: " << total_throughput_gbps << " Gb/s" << std::endl;
         
+        if (reordered_packets > 0) {
+            std::cout << "\nReordering:" << std::endl;
+            std::cout << "  Reordered packets: " << reordered_packets << " ("
+                      << (100.0 * reordered_packets / delivered_packets) << "%)" << std::endl;
+            std::cout << "  Max reorder distance: " << max_reorder_distance << " pkts" << std::endl;
+            std::cout << "  Max reorder buffer: " << max_reorder_occupancy << " pkts" << std::endl;
+            std::cout << "  Reorder buffer occupancy histogram:" << std::endl;
+            for (size_t k = 0; k < reorder_occupancy_hist.size(); k++) {
+                if (reorder_occupancy_hist[k] == 0) continue;
+                std::cout << "    " << std::setw(12) << occupancyBucketName(k) << ": "
+                          << reorder_occupancy_hist[k] << std::endl;
+            }
+        }
+        
+        if (deferred_transmissions > 0) {
+            std::cout << "\nSlot Fragmentation:" << std::endl;
+            std::cout << "  Deferred transmissions: " << deferred_transmissions << std::endl;
+            std::cout << "  Capacity lost: " << fragmentation_lost_bytes / 1e6 << " MB ("
+                      << (circuit_capacity_bytes > 0 ? 100.0 * fragmentation_lost_bytes / circuit_capacity_bytes : 0.0)
+                      << "% of circuit capacity)" << std::endl;
+        }
+        
+        if (steady_detection) {
+            std::cout << "\nSteady State:" << std::endl;
+            if (warmup_ms >= 0) {
+                std::cout << "  Warm-up trimmed: " << warmup_ms << " ms (" << warmup_flows << " flows excluded)" << std::endl;
+            } else {
+                std::cout << "  Warm-up trimmed: none (steady state not reached)" << std::endl;
+            }
+            if (early_stop_ms >= 0) {
+                std::cout << "  Stopped early at: " << early_stop_ms << " ms (p99 FCT converged)" << std::endl;
+            }
+        }
+        
+        if (drain_mode) {
+            std::cout << "\nDrain:" << std::endl;
+            std::cout << "  Drained for: " << drain_ms << " ms after arrivals stopped" << std::endl;
+            std::cout << "  Censored flows: " << censored_ages_ms.size() << " (unfinished, not in FCTs)" << std::endl;
+            if (!censored_ages_ms.empty()) {
+                std::cout << "  Censored age median: " << getPercentile(censored_ages_ms, 0.5) << " ms" << std::endl;
+                std::cout << "  Censored age max: " << getPercentile(censored_ages_ms, 1.0) << " ms" << std::endl;
+            }
+        }
+        
+        if (!rack_paused_ms.empty()) {
+            double total = std::accumulate(rack_paused_ms.begin(), rack_paused_ms.end(), 0.0);
+            double max_paused = *std::max_element(rack_paused_ms.begin(), rack_paused_ms.end());
+            std::cout << "\nBackpressure (lossless):" << std::endl;
+            std::cout << "  Mean paused time per rack: " << total / rack_paused_ms.size() << " ms" << std::endl;
+            std::cout << "  Max paused time per rack: " << max_paused << " ms" << std::endl;
+        }
+        
+        if (!time_series.empty()) {
+            size_t peak_idx;
+            double drain_ms = getDrainTimeMs(peak_idx);
+            std::cout << "\nVOQ Backlog:" << std::endl;
+            std::cout << "  Peak: " << time_series[peak_idx].voq_backlog_pkts << " pkts at "
+                      << time_series[peak_idx].time_ms << " ms" << std::endl;
+            if (drain_ms >= 0) {
+                std::cout << "  Drain time (to 10% of peak): " << drain_ms << " ms" << std::endl;
+            } else {
+                std::cout << "  Drain time (to 10% of peak): not drained" << std::endl;
+            }
+        }
+        
         std::cout << "\n========================================" << std::endl;
     }
     
@@ -121,7 +432,39 @@ public:
         file << "total_flows," << total_flows << "\n";
         file << "completed_flows," << completed_flows << "\n";
         file << "dropped_packets," << dropped_packets << "\n";
+        file << "retransmitted_packets," << retransmitted_packets << "\n";
+        file << "packet_switch_drops," << packet_switch_drops << "\n";
         file << "throughput_gbps," << total_throughput_gbps << "\n";
+        file << "deferred_transmissions," << deferred_transmissions << "\n";
+        file << "fragmentation_lost_bytes," << fragmentation_lost_bytes << "\n";
+        
+        file << "reordered_packets," << reordered_packets << "\n";
+        file << "max_reorder_distance," << max_reorder_distance << "\n";
+        file << "max_reorder_buffer_pkts," << max_reorder_occupancy << "\n";
+        for (size_t k = 0; k < reorder_occupancy_hist.size(); k++) {
+            file << "reorder_buffer_" << occupancyBucketName(k) << "," << reorder_occupancy_hist[k] << "\n";
+        }
+        
+        if (steady_detection) {
+            file << "warmup_ms," << warmup_ms << "\n";
+            file << "warmup_flows_excluded," << warmup_flows << "\n";
+            file << "early_stop_ms," << early_stop_ms << "\n";
+        }
+        
+        if (drain_mode) {
+            file << "drain_ms," << drain_ms << "\n";
+            file << "censored_flows," << censored_ages_ms.size() << "\n";
+            if (!censored_ages_ms.empty()) {
+                file << "censored_median_age_ms," << getPercentile(censored_ages_ms, 0.5) << "\n";
+                file << "censored_max_age_ms," << getPercentile(censored_ages_ms, 1.0) << "\n";
+            }
+        }
+        
+        if (!rack_paused_ms.empty()) {
+            for (size_t i = 0; i < rack_paused_ms.size(); i++) {
+                file << "rack" << i << "_paused_ms," << rack_paused_ms[i] << "\n";
+            }
+        }
         
         if (!all_fcts.empty()) {
             file << "mean_fct_ms," << getMean(all_fcts) << "\n";
@@ -130,9 +473,79 @@ public:
             file << "p99_fct_ms," << getPercentile(all_fcts, 0.99) << "\n";
         }
         
+        if (!fcts_low_latency.empty()) {
+            file << "low_latency_completed_flows," << fcts_low_latency.size() << "\n";
+            file << "low_latency_mean_fct_ms," << getMean(fcts_low_latency) << "\n";
+            file << "low_latency_p99_fct_ms," << getPercentile(fcts_low_latency, 0.99) << "\n";
+        }
+        if (!fcts_bulk.empty()) {
+            file << "bulk_mean_fct_ms," << getMean(fcts_bulk) << "\n";
+            file << "bulk_p99_fct_ms," << getPercentile(fcts_bulk, 0.99) << "\n";
+        }
+        
         file.close();
         std::cout << "Results saved to " << filename << std::endl;
     }
+    
+    // Side-by-side summary of several runs (e.g. one per routing policy)
+    static void printComparison(const std::vector<std::string>& names,
+                                const std::vector<Statistics>& runs) {
+        std::cout << "\n========== Comparison ==========" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << std::left << std::setw(12) << "run" << std::right
+                  << std::setw(12) << "completed%" << std::setw(12) << "drops"
+                  << std::setw(12) << "mean_ms" << std::setw(12) << "p99_ms"
+                  << std::setw(12) << "gbps" << std::endl;
+        for (size_t i = 0; i < runs.size(); i++) {
+            const Statistics& r = runs[i];
+            std::cout << std::left << std::setw(12) << names[i] << std::right
+                      << std::setw(12) << (r.total_flows ? 100.0 * r.completed_flows / r.total_flows : 0.0)
+                      << std::setw(12) << r.dropped_packets
+                      << std::setw(12) << r.getMeanFct()
+                      << std::setw(12) << r.getFctPercentile(0.99)
+                      << std::setw(12) << r.total_throughput_gbps << std::endl;
+        }
+        std::cout << "================================" << std::endl;
+    }
+    
+    static void saveComparison(const std::string& filename, const std::vector<std::string>& names,
+                               const std::vector<Statistics>& runs) {
+        std::ofstream file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Warning: Could not open " << filename << " for writing" << std::endl;
+            return;
+        }
+        
+        file << "run,total_flows,completed_flows,dropped_packets,throughput_gbps,mean_fct_ms,p99_fct_ms\n";
+        for (size_t i = 0; i < runs.size(); i++) {
+            const Statistics& r = runs[i];
+            file << names[i] << "," << r.total_flows << "," << r.completed_flows << ","
+                 << r.dropped_packets << "," << r.total_throughput_gbps << ","
+                 << r.getMeanFct() << "," << r.getFctPercentile(0.99) << "\n";
+        }
+        
+        file.close();
+        std::cout << "Comparison saved to " << filename << std::endl;
+    }
+    
+    void saveTimeSeries(const std::string& filename) const {
+        if (time_series.empty()) return;
+        
+        std::ofstream file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Warning: Could not open " << filename << " for writing" << std::endl;
+            return;
+        }
+        
+        file << "time_ms,offered_gbps,goodput_gbps,voq_backlog_pkts,max_voq_pkts,drops\n";
+        for (const auto& s : time_series) {
+            file << s.time_ms << "," << s.offered_gbps << "," << s.goodput_gbps << ","
+                 << s.voq_backlog_pkts << "," << s.max_voq_pkts << "," << s.drops << "\n";
+        }
+        
+        file.close();
+        std::cout << "Time series saved to " << filename << std::endl;
+    }
 };
 
 #endif // STATS_H
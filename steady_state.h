@@ -0,0 +1,106 @@
+// steady_state.h - Online warm-up detection (MSER-5) and p99 FCT confidence intervals
+#ifndef STEADY_STATE_H
+#define STEADY_STATE_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "checkpoint.h"
+
+// Detects the end of the warm-up transient from the sampled time series
+// (sample_interval_ms). Each series is cut into batches of BATCH_SIZE samples and
+// MSER-5 picks the truncation point d minimizing
+//   sum_{i>=d} (Y_i - mean_d)^2 / (k - d)^2
+// over the batch means Y_i, d <= k / 2. If the minimum falls at k / 2 the series
+// is still trending and the run is not yet in steady state.
+// Goodput and VOQ backlog must both have settled, so warm-up ends at the later
+// of their truncation points.
+class SteadyStateDetector {
+private:
+    static constexpr size_t BATCH_SIZE = 5;
+    static constexpr size_t MIN_BATCHES = 10;
+
+    std::vector<double> goodput_gbps;
+    std::vector<double> backlog_pkts;
+
+    // Truncation point of series in samples, or -1 while it is still transient
+    static long mser5(const std::vector<double>& series) {
+        size_t k = series.size() / BATCH_SIZE;
+        if (k < MIN_BATCHES) return -1;
+
+        std::vector<double> batch(k, 0.0);
+        for (size_t i = 0; i < k * BATCH_SIZE; i++) {
+            batch[i / BATCH_SIZE] += series[i] / BATCH_SIZE;
+        }
+
+        // Scan d downwards with suffix sums; ties go to the smaller d
+        double sum = 0.0, sum_sq = 0.0;
+        double best = std::numeric_limits<double>::infinity();
+        size_t best_d = k / 2;
+        for (size_t d = k; d-- > 0;) {
+            sum += batch[d];
+            sum_sq += batch[d] * batch[d];
+            if (d > k / 2) continue;
+            double n = static_cast<double>(k - d);
+            double mser = std::max(0.0, sum_sq - sum * sum / n) / (n * n);
+            if (mser <= best) {
+                best = mser;
+                best_d = d;
+            }
+        }
+        if (best_d == k / 2) return -1;
+        return static_cast<long>(best_d * BATCH_SIZE);
+    }
+
+public:
+    void addSample(double goodput, double backlog) {
+        goodput_gbps.push_back(goodput);
+        backlog_pkts.push_back(static_cast<double>(backlog));
+    }
+
+    // Samples of warm-up to discard, or -1 if steady state has not been reached
+    long getWarmupSamples() const {
+        long goodput_d = mser5(goodput_gbps);
+        long backlog_d = mser5(backlog_pkts);
+        if (goodput_d < 0 || backlog_d < 0) return -1;
+        return std::max(goodput_d, backlog_d);
+    }
+
+    // Relative half-width of a distribution-free confidence interval for the p99
+    // of fcts and `censored` further flows, still open, that rank above every
+    // completed one (order statistics around rank 0.99 n, normal approximation
+    // to the binomial). Infinite if there are too few samples for the interval
+    // or it reaches into the censored flows. Linear: reorders fcts to select the
+    // three order statistics, without sorting.
+    static double getP99RelativeHalfWidth(std::vector<double>& fcts, size_t censored = 0, double z = 1.96) {
+        const double p = 0.99;
+        double n = static_cast<double>(fcts.size() + censored);
+        double spread = z * std::sqrt(n * p * (1.0 - p));
+        double lo = std::floor(n * p - spread);
+        double hi = std::ceil(n * p + spread);
+        if (lo < 0 || hi >= static_cast<double>(fcts.size())) return std::numeric_limits<double>::infinity();
+
+        // Each selection leaves the smaller values in front of the next rank
+        auto hi_it = fcts.begin() + static_cast<size_t>(hi);
+        auto p99_it = fcts.begin() + static_cast<size_t>(n * p);
+        auto lo_it = fcts.begin() + static_cast<size_t>(lo);
+        std::nth_element(fcts.begin(), hi_it, fcts.end());
+        std::nth_element(fcts.begin(), p99_it, hi_it);
+        std::nth_element(fcts.begin(), lo_it, p99_it);
+        if (*p99_it <= 0) return std::numeric_limits<double>::infinity();
+        return (*hi_it - *lo_it) / (2.0 * *p99_it);
+    }
+
+    void save(CheckpointWriter& out) const {
+        out.putVector(goodput_gbps);
+        out.putVector(backlog_pkts);
+    }
+
+    void load(CheckpointReader& in) {
+        in.getVector(goodput_gbps);
+        in.getVector(backlog_pkts);
+    }
+};
+
+#endif // STEADY_STATE_H
@@ -0,0 +1,70 @@
+// test.h - Minimal test registry and checks for the unit tests (make test)
+#ifndef TEST_H
+#define TEST_H
+
+#include <iostream>
+#include <vector>
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+inline std::vector<TestCase>& testRegistry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+// Failed checks of the test currently running
+inline int& testFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+struct TestRegistrar {
+    TestRegistrar(const char* name, void (*run)()) { testRegistry().push_back({name, run}); }
+};
+
+// TEST(name) { ... } defines a test that test_main.cpp runs
+#define TEST(name)                                                  \
+    static void name();                                             \
+    static TestRegistrar name##_registrar(#name, name);             \
+    static void name()
+
+// Checks report and count a failure, then let the test carry on
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed"   \
+                      << std::endl;                                                   \
+            testFailures()++;                                                         \
+        }                                                                             \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                \
+    do {                                                                              \
+        auto check_a_ = (a);                                                          \
+        auto check_b_ = (b);                                                          \
+        if (!(check_a_ == check_b_)) {                                                \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #a ", " #b      \
+                      << ") failed: " << check_a_ << " != " << check_b_ << std::endl; \
+            testFailures()++;                                                         \
+        }                                                                             \
+    } while (0)
+
+#define CHECK_THROWS(expr)                                                            \
+    do {                                                                              \
+        bool check_threw_ = false;                                                    \
+        try {                                                                         \
+            expr;                                                                     \
+        } catch (const std::exception&) {                                             \
+            check_threw_ = true;                                                      \
+        }                                                                             \
+        if (!check_threw_) {                                                          \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_THROWS(" #expr       \
+                      << ") did not throw" << std::endl;                              \
+            testFailures()++;                                                         \
+        }                                                                             \
+    } while (0)
+
+#endif // TEST_H
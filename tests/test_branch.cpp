@@ -0,0 +1,57 @@
+// test_branch.cpp - A forked branch continues exactly as a restore under its config
+#include <cstdio>
+#include "test_sim.h"
+#include "../simulator.h"
+
+// The prefix checkpointed at the branch time and restored under the variant's
+// config must match the variant's branch, and the base must match a plain run
+static void checkBranchMatchesRestore(const SimConfig& base, const SimConfig& variant) {
+    const char* checkpoint = "test_branch.bin";
+    SimConfig save_cfg = base;
+    save_cfg.checkpoint_time_ms = 4.3;
+    save_cfg.checkpoint_file = checkpoint;
+    Statistics full = runSimulation(save_cfg);
+    
+    SimConfig restore_cfg = variant;
+    restore_cfg.restore_file = checkpoint;
+    Statistics restored = runSimulation(restore_cfg);
+    std::remove(checkpoint);
+    
+    SimConfig branch_cfg = base;
+    branch_cfg.branch_time_ms = 4.3;
+    std::vector<Statistics> branches = runBranches(branch_cfg, {variant});
+    CHECK_EQ(branches.size(), 2u);
+    if (branches.size() != 2) return;
+    CHECK(restored.getCompletedFlows() > 0);
+    checkSameResults(full, branches[0]);
+    checkSameResults(restored, branches[1]);
+}
+
+TEST(branch_matches_restore_routing) {
+    SimConfig base = quietConfig();
+    base.sample_interval_ms = 0.5;
+    base.routing = RoutingMode::VLB;
+    SimConfig variant = base;
+    variant.routing = RoutingMode::THRESHOLD;
+    checkBranchMatchesRestore(base, variant);
+}
+
+TEST(branch_matches_restore_retransmit) {
+    SimConfig base = quietConfig();
+    base.sample_interval_ms = 0.5;
+    base.queue_size_pkts = 20;
+    SimConfig variant = base;
+    variant.retransmit = true;
+    variant.drain_cap_ms = 5;
+    checkBranchMatchesRestore(base, variant);
+}
+
+TEST(branch_rejects_arrival_changes_and_no_ops) {
+    SimConfig base = quietConfig();
+    base.branch_time_ms = 4.3;
+    for (SimConfig variant : {base.withOverrides("sim_time_ms=20"), base.withOverrides("load_factor=0.9"),
+                              base.withOverrides("random_seed=8"), base.withOverrides("workload=websearch"),
+                              base.withOverrides("queue_threshold=4"), base.withOverrides("sample_interval_ms=1")}) {
+        CHECK_THROWS(runBranches(base, {variant}));
+    }
+}
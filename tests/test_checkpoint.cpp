@@ -0,0 +1,50 @@
+// test_checkpoint.cpp - A restored run is bit-identical to the uninterrupted one
+#include <cstdio>
+#include "test_sim.h"
+#include "../simulator.h"
+
+// Runs cfg straight through, again writing a checkpoint part way, and once more
+// from that checkpoint: all three must agree exactly
+static void checkRestoreMatches(SimConfig cfg) {
+    const char* checkpoint = "test_checkpoint.bin";
+    cfg.sample_interval_ms = 0.5;
+    Statistics full = runSimulation(cfg);
+    
+    SimConfig save_cfg = cfg;
+    save_cfg.checkpoint_time_ms = 4.3;
+    save_cfg.checkpoint_file = checkpoint;
+    Statistics saved = runSimulation(save_cfg);
+    
+    SimConfig restore_cfg = cfg;
+    restore_cfg.restore_file = checkpoint;
+    Statistics restored = runSimulation(restore_cfg);
+    std::remove(checkpoint);
+    
+    CHECK(full.getCompletedFlows() > 0);
+    checkSameResults(full, saved);
+    checkSameResults(full, restored);
+}
+
+TEST(checkpoint_restore_hosts_retransmit) {
+    SimConfig cfg = quietConfig();
+    cfg.model_hosts = true;
+    cfg.retransmit = true;
+    cfg.queue_size_pkts = 50;
+    checkRestoreMatches(cfg);
+}
+
+TEST(checkpoint_restore_lossless_rotorlb) {
+    SimConfig cfg = quietConfig();
+    cfg.lossless = true;
+    cfg.routing = RoutingMode::ROTORLB;
+    checkRestoreMatches(cfg);
+}
+
+TEST(checkpoint_restore_trains_hybrid_packet_switch) {
+    SimConfig cfg = quietConfig();
+    cfg.routing = RoutingMode::DIRECT;
+    cfg.packet_train_max_pkts = 16;
+    cfg.hybrid_fluid_min_bytes = 100000;
+    cfg.packet_switch_gbps = 10;
+    checkRestoreMatches(cfg);
+}
@@ -0,0 +1,35 @@
+// test_crn.cpp - Common random numbers pair up the runs of a routing sweep
+#include "test_sim.h"
+#include "../simulator.h"
+
+// A run on its own matches its row of a sweep that shares one workload
+TEST(crn_solo_run_matches_shared_workload) {
+    SimConfig cfg = quietConfig();
+    cfg.common_random_numbers = true;
+    cfg.sample_interval_ms = 0.5;
+    for (RoutingMode mode : {RoutingMode::VLB, RoutingMode::POWER_OF_D, RoutingMode::THRESHOLD}) {
+        cfg.routing = mode;
+        std::shared_ptr<const std::vector<Flow>> shared = generateSharedFlows(cfg);
+        checkSameResults(runSimulation(cfg), runSimulation(cfg, shared));
+    }
+}
+
+// Every policy sees the same arrivals, window by window
+TEST(crn_policies_see_same_arrivals) {
+    SimConfig cfg = quietConfig();
+    cfg.common_random_numbers = true;
+    cfg.sample_interval_ms = 0.5;
+    std::shared_ptr<const std::vector<Flow>> shared = generateSharedFlows(cfg);
+    cfg.routing = RoutingMode::VLB;
+    Statistics vlb = runSimulation(cfg, shared);
+    cfg.routing = RoutingMode::DIRECT;
+    Statistics direct = runSimulation(cfg, shared);
+    
+    CHECK_EQ(vlb.getTotalFlows(), direct.getTotalFlows());
+    const std::vector<TimeSeriesSample>& a = vlb.getTimeSeries();
+    const std::vector<TimeSeriesSample>& b = direct.getTimeSeries();
+    CHECK_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+        CHECK_EQ(a[i].offered_gbps, b[i].offered_gbps);
+    }
+}
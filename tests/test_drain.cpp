@@ -0,0 +1,52 @@
+// test_drain.cpp - Drain mode ends when flows finish, the network idles or the cap hits
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include "test_sim.h"
+#include "../simulator.h"
+
+// Direct routing over 8 racks; the round-robin matchings leave rack 0 without
+// circuits, so only flows touching it can never finish
+static Statistics runFlows(const std::string& rows, int queue_size_pkts) {
+    const char* flow_file = "test_drain_flows.csv";
+    {
+        std::ofstream file(flow_file);
+        file << "flow_id,src_rack,dst_rack,src_host,dst_host,size_bytes,start_time_ms,flow_type\n" << rows;
+    }
+    SimConfig cfg = quietConfig();
+    cfg.num_racks = 8;
+    cfg.num_switches = 7;
+    cfg.routing = RoutingMode::DIRECT;
+    cfg.flow_file = flow_file;
+    cfg.sim_time_ms = 1;
+    cfg.drain_cap_ms = 50;
+    cfg.queue_size_pkts = queue_size_pkts;
+    Statistics stats = runSimulation(cfg);
+    std::remove(flow_file);
+    return stats;
+}
+
+TEST(drain_finishes_open_flows) {
+    Statistics stats = runFlows("0,1,2,0,0,2000000,0.9,bulk\n1,3,4,0,0,300000,0.95,bulk\n", 100000);
+    CHECK_EQ(stats.getTotalFlows(), 2);
+    CHECK_EQ(stats.getCompletedFlows(), 2);
+    CHECK_EQ(stats.getCensoredFlows(), 0u);
+    CHECK(stats.getDrainMs() > 0);
+    CHECK(stats.getDrainMs() < 50);
+}
+
+// Without retransmission a dropped packet's flow never finishes: the drain
+// stops once nothing is left in flight
+TEST(drain_stops_when_network_idle) {
+    Statistics stats = runFlows("0,1,2,0,0,2000000,0.9,bulk\n", 5);
+    CHECK_EQ(stats.getCompletedFlows(), 0);
+    CHECK_EQ(stats.getCensoredFlows(), 1u);
+    CHECK(stats.getDrainMs() < 50);
+}
+
+TEST(drain_stops_at_cap) {
+    Statistics stats = runFlows("0,1,0,0,0,3000,0.9,bulk\n1,3,4,0,0,3000,0.9,bulk\n", 100000);
+    CHECK_EQ(stats.getCompletedFlows(), 1);
+    CHECK_EQ(stats.getCensoredFlows(), 1u);
+    CHECK_EQ(stats.getDrainMs(), 50.0);
+}
@@ -0,0 +1,32 @@
+// test_fluid.cpp - The fluid engine honours the run options replications rely on
+#include <cmath>
+#include "test_sim.h"
+#include "../simulator.h"
+
+static SimConfig fluidConfig() {
+    SimConfig cfg = quietConfig();
+    cfg.engine = SimEngine::FLUID;
+    cfg.routing = RoutingMode::DIRECT;
+    return cfg;
+}
+
+// Replications stream FCTs: the sketch must hold every completed flow
+TEST(fluid_streams_fcts_into_sketch) {
+    SimConfig cfg = fluidConfig();
+    Statistics listed = runSimulation(cfg);
+    cfg.stream_fcts = true;
+    Statistics streamed = runSimulation(cfg);
+    
+    CHECK(listed.getCompletedFlows() > 0);
+    CHECK_EQ(streamed.getCompletedFlows(), listed.getCompletedFlows());
+    CHECK_EQ(streamed.getFctSketch().getCount(), static_cast<uint64_t>(listed.getCompletedFlows()));
+    double median = listed.getFctPercentile(0.5);
+    CHECK(std::abs(streamed.getFctPercentile(0.5) - median) <= 0.01 * median);
+}
+
+// Every policy would give the same fluid run
+TEST(fluid_rejects_compare_routing) {
+    SimConfig cfg = fluidConfig();
+    cfg.compare_routing = {RoutingMode::DIRECT, RoutingMode::VLB};
+    CHECK_THROWS(runSimulation(cfg));
+}
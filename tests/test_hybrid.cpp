@@ -0,0 +1,52 @@
+// test_hybrid.cpp - Fluid elephants leave every other flow as the packet engine does
+#include <cmath>
+#include "test_sim.h"
+#include "../simulator.h"
+
+// The packets an elephant stands for fill its VOQ: the mice behind it queue or
+// are dropped as they would be behind its packets, and without retransmission
+// the elephant itself loses what does not fit
+static void checkHybridMatchesPackets(SimConfig cfg) {
+    cfg.routing = RoutingMode::DIRECT;
+    cfg.hybrid_fluid_min_bytes = 0;
+    Statistics packets = runSimulation(cfg);
+    cfg.hybrid_fluid_min_bytes = 1000000;
+    Statistics hybrid = runSimulation(cfg);
+    
+    CHECK(packets.getCompletedFlows() > 0);
+    CHECK_EQ(packets.getTotalFlows(), hybrid.getTotalFlows());
+    CHECK_EQ(packets.getCompletedFlows(), hybrid.getCompletedFlows());
+    CHECK(sortedFcts(packets) == sortedFcts(hybrid));
+    
+    // A chunk's packets leave the VOQ together when it starts, one at a time in
+    // the packet engine, so admissions differ by a handful of packets
+    double drops = packets.getDroppedPackets();
+    CHECK(std::abs(hybrid.getDroppedPackets() - drops) <= 1e-3 * drops);
+    CHECK(std::abs(hybrid.getThroughputGbps() - packets.getThroughputGbps()) <= 0.01 * packets.getThroughputGbps());
+}
+
+TEST(hybrid_matches_packets_small_queues) {
+    SimConfig cfg = quietConfig();
+    cfg.queue_size_pkts = 100;
+    checkHybridMatchesPackets(cfg);
+}
+
+TEST(hybrid_matches_packets_large_queues) {
+    SimConfig cfg = quietConfig();
+    cfg.load_factor = 0.3;
+    cfg.queue_size_pkts = 1000;
+    checkHybridMatchesPackets(cfg);
+}
+
+TEST(hybrid_rejects_non_direct_lossless_hosts) {
+    SimConfig cfg = quietConfig();
+    cfg.hybrid_fluid_min_bytes = 1000000;
+    cfg.routing = RoutingMode::THRESHOLD;
+    CHECK_THROWS(runSimulation(cfg));
+    cfg.routing = RoutingMode::DIRECT;
+    cfg.lossless = true;
+    CHECK_THROWS(runSimulation(cfg));
+    cfg.lossless = false;
+    cfg.model_hosts = true;
+    CHECK_THROWS(runSimulation(cfg));
+}
@@ -0,0 +1,38 @@
+// test_lossless.cpp - Lossless backpressure holds packets instead of dropping them
+#include "test_sim.h"
+#include "../simulator.h"
+
+// VOQs of 20 packets at high load, with VLB traffic reserving buffer at intermediates
+static void checkLosslessNeverDrops(RoutingMode routing) {
+    SimConfig cfg = quietConfig();
+    cfg.load_factor = 0.9;
+    cfg.queue_size_pkts = 20;
+    cfg.routing = routing;
+    cfg.lossless = true;
+    Statistics stats = runSimulation(cfg);
+    CHECK_EQ(stats.getDroppedPackets(), 0);
+    CHECK(stats.getCompletedFlows() > 0);
+}
+
+TEST(lossless_never_drops_vlb) {
+    checkLosslessNeverDrops(RoutingMode::VLB);
+}
+
+TEST(lossless_never_drops_threshold) {
+    checkLosslessNeverDrops(RoutingMode::THRESHOLD);
+}
+
+// Held packets are admitted again as VOQs drain, so every flow finishes
+TEST(lossless_finishes_every_flow) {
+    SimConfig cfg = quietConfig();
+    cfg.queue_size_pkts = 10;
+    for (RoutingMode routing : {RoutingMode::DIRECT, RoutingMode::VLB}) {
+        cfg.routing = routing;
+        cfg.lossless = true;
+        Statistics stats = runAllPairsFlows(cfg);
+        CHECK_EQ(stats.getTotalFlows(), 12);
+        CHECK_EQ(stats.getCompletedFlows(), 12);
+        CHECK_EQ(stats.getDroppedPackets(), 0);
+        CHECK(stats.getDrainMs() < 200);
+    }
+}
@@ -0,0 +1,21 @@
+// test_main.cpp - Runs every registered test (make test)
+#include <iostream>
+#include <exception>
+#include "test.h"
+
+int main() {
+    int failed = 0;
+    for (const TestCase& test : testRegistry()) {
+        testFailures() = 0;
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            std::cerr << "  unexpected exception: " << e.what() << std::endl;
+            testFailures()++;
+        }
+        std::cout << (testFailures() == 0 ? "[ OK ] " : "[FAIL] ") << test.name << std::endl;
+        if (testFailures() > 0) failed++;
+    }
+    std::cout << testRegistry().size() - failed << "/" << testRegistry().size() << " tests passed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+// test_quantile_sketch.cpp - Relative error and exact merging of QuantileSketch
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "test.h"
+#include "../rng.h"
+#include "../quantile_sketch.h"
+
+static const double QUANTILES[] = {0.0, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999, 1.0};
+
+// Values from microseconds to seconds (in ms), log-uniform
+static std::vector<double> spreadValues(uint64_t stream, int n) {
+    PhiloxRng rng(11, stream);
+    std::vector<double> values;
+    for (int i = 0; i < n; i++) values.push_back(1e-3 * std::pow(10.0, 6.0 * rng.nextDouble()));
+    return values;
+}
+
+TEST(sketch_quantiles_within_relative_error) {
+    std::vector<double> values = spreadValues(0, 20000);
+    QuantileSketch sketch(0.01);
+    for (double v : values) sketch.add(v);
+    std::sort(values.begin(), values.end());
+    
+    CHECK_EQ(sketch.getCount(), values.size());
+    for (double q : QUANTILES) {
+        size_t rank = std::min(static_cast<size_t>(q * values.size()), values.size() - 1);
+        double exact = values[rank];
+        CHECK(std::abs(sketch.quantile(q) - exact) <= 0.01 * exact);
+    }
+}
+
+TEST(sketch_merge_equals_combined) {
+    std::vector<double> a = spreadValues(1, 5000);
+    std::vector<double> b = spreadValues(2, 7000);
+    QuantileSketch merged, combined, part;
+    for (double v : a) {
+        merged.add(v);
+        combined.add(v);
+    }
+    for (double v : b) {
+        part.add(v);
+        combined.add(v);
+    }
+    merged.merge(part);
+    
+    CHECK_EQ(merged.getCount(), combined.getCount());
+    for (double q : QUANTILES) {
+        CHECK_EQ(merged.quantile(q), combined.quantile(q));
+    }
+}
+
+TEST(sketch_zero_and_empty) {
+    QuantileSketch empty;
+    CHECK_EQ(empty.quantile(0.5), 0.0);
+    
+    QuantileSketch sketch;
+    for (int i = 0; i < 10; i++) sketch.add(0.0);
+    for (int i = 0; i < 10; i++) sketch.add(5.0);
+    CHECK_EQ(sketch.quantile(0.25), 0.0);
+    CHECK(std::abs(sketch.quantile(0.75) - 5.0) <= 0.05);
+}
@@ -0,0 +1,30 @@
+// test_rotorlb.cpp - RotorLB only relays what intermediates accepted buffer for
+#include "test_sim.h"
+#include "../simulator.h"
+
+// Source VOQs large enough never to fill at high load, so any drop would be
+// an intermediate overflowing its accepted credits
+static void checkRotorLbNeverDrops(TopologyType topology) {
+    SimConfig cfg = quietConfig();
+    cfg.topology = topology;
+    cfg.load_factor = 0.9;
+    cfg.queue_size_pkts = 1000000;
+    cfg.routing = RoutingMode::ROTORLB;
+    Statistics rotorlb = runSimulation(cfg);
+    cfg.routing = RoutingMode::DIRECT;
+    Statistics direct = runSimulation(cfg);
+    
+    CHECK_EQ(rotorlb.getDroppedPackets(), 0);
+    CHECK(rotorlb.getCompletedFlows() > 0);
+    // Some traffic did take two hops
+    CHECK(sortedFcts(rotorlb) != sortedFcts(direct));
+}
+
+TEST(rotorlb_never_drops_at_intermediates_rotor) {
+    checkRotorLbNeverDrops(TopologyType::ROTOR);
+}
+
+// Opera regrants each switch's uplinks as that switch reconfigures
+TEST(rotorlb_never_drops_at_intermediates_opera) {
+    checkRotorLbNeverDrops(TopologyType::OPERA);
+}
@@ -0,0 +1,91 @@
+// test_sim.h - Helpers for tests that run the simulator end to end
+#ifndef TEST_SIM_H
+#define TEST_SIM_H
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "../config.h"
+#include "../stats.h"
+#include "../simulator.h"
+
+// Small, fast fabric with no console or file output
+inline SimConfig quietConfig() {
+    SimConfig cfg;
+    cfg.num_racks = 16;
+    cfg.num_switches = 4;
+    cfg.sim_time_ms = 10;
+    cfg.load_factor = 0.5;
+    cfg.random_seed = 7;
+    cfg.quiet = true;
+    cfg.save_flows = false;
+    return cfg;
+}
+
+// Every completed FCT in ascending order, read back one rank at a time
+inline std::vector<double> sortedFcts(const Statistics& stats) {
+    std::vector<double> fcts;
+    int n = stats.getCompletedFlows();
+    for (int i = 0; i < n; i++) {
+        fcts.push_back(stats.getFctPercentile((i + 0.5) / n));
+    }
+    return fcts;
+}
+
+// Same flows completed with the same FCTs, drops, throughput and time series
+inline void checkSameResults(const Statistics& a, const Statistics& b) {
+    CHECK_EQ(a.getTotalFlows(), b.getTotalFlows());
+    CHECK_EQ(a.getCompletedFlows(), b.getCompletedFlows());
+    CHECK_EQ(a.getDroppedPackets(), b.getDroppedPackets());
+    CHECK_EQ(a.getThroughputGbps(), b.getThroughputGbps());
+    CHECK(sortedFcts(a) == sortedFcts(b));
+    
+    const std::vector<TimeSeriesSample>& sa = a.getTimeSeries();
+    const std::vector<TimeSeriesSample>& sb = b.getTimeSeries();
+    CHECK_EQ(sa.size(), sb.size());
+    for (size_t i = 0; i < sa.size() && i < sb.size(); i++) {
+        CHECK_EQ(sa[i].goodput_gbps, sb[i].goodput_gbps);
+        CHECK_EQ(sa[i].voq_backlog_pkts, sb[i].voq_backlog_pkts);
+        CHECK_EQ(sa[i].max_voq_pkts, sb[i].max_voq_pkts);
+        CHECK_EQ(sa[i].drops, sb[i].drops);
+    }
+}
+
+// Every ordered pair of 4 racks starts a 200 KB flow within 0.1 ms, over one
+// switch whose schedule connects each pair once per cycle (the generated
+// round-robin tables leave rack 0 without circuits), then drains for up to
+// 200 ms. With queue_size_pkts small, VOQs overflow at every rack.
+inline Statistics runAllPairsFlows(SimConfig cfg) {
+    const char* schedule = "test_all_pairs_schedule.csv";
+    const char* flow_file = "test_all_pairs_flows.csv";
+    {
+        std::ofstream file(schedule);
+        file << "0,1,0,3,2\n0,2,3,0,1\n0,3,2,1,0\n";
+    }
+    {
+        std::ofstream file(flow_file);
+        file << "flow_id,src_rack,dst_rack,src_host,dst_host,size_bytes,start_time_ms,flow_type\n";
+        int id = 0;
+        for (int src = 0; src < 4; src++) {
+            for (int dst = 0; dst < 4; dst++) {
+                if (src == dst) continue;
+                file << id << "," << src << "," << dst << ",0,0,200000," << 0.1 + 0.01 * id << ",bulk\n";
+                id++;
+            }
+        }
+    }
+    cfg.num_racks = 4;
+    cfg.num_switches = 1;
+    cfg.schedule_file = schedule;
+    cfg.flow_file = flow_file;
+    cfg.sim_time_ms = 1;
+    cfg.drain_cap_ms = 200;
+    Statistics stats = runSimulation(cfg);
+    std::remove(schedule);
+    std::remove(flow_file);
+    return stats;
+}
+
+#endif // TEST_SIM_H
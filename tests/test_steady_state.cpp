@@ -0,0 +1,74 @@
+// test_steady_state.cpp - MSER-5 warm-up detection and the p99 FCT interval
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "test.h"
+#include "../rng.h"
+#include "../steady_state.h"
+
+// Level 10 after an exponential transient of transient_samples, plus a ripple
+// that cancels within each 5-sample batch: batch means are exactly 10 once the
+// transient is over
+static double settlingSample(int i, int transient_samples) {
+    const double ripple[5] = {0.4, -0.3, 0.2, -0.1, -0.2};
+    double level = i < transient_samples ? 10.0 + 90.0 * std::exp(-4.0 * i / transient_samples) : 10.0;
+    return level + ripple[i % 5];
+}
+
+TEST(mser5_trims_the_transient) {
+    SteadyStateDetector detector;
+    for (int i = 0; i < 100; i++) {
+        detector.addSample(settlingSample(i, 20), settlingSample(i, 20));
+    }
+    CHECK_EQ(detector.getWarmupSamples(), 20);
+}
+
+TEST(mser5_takes_the_later_series) {
+    SteadyStateDetector goodput_only;
+    SteadyStateDetector both;
+    for (int i = 0; i < 150; i++) {
+        goodput_only.addSample(settlingSample(i, 10), 10.0);
+        both.addSample(settlingSample(i, 10), settlingSample(i, 40));
+    }
+    CHECK_EQ(goodput_only.getWarmupSamples(), 10);
+    CHECK_EQ(both.getWarmupSamples(), 40);
+}
+
+TEST(mser5_not_steady_while_trending_or_short) {
+    SteadyStateDetector ramp;
+    for (int i = 0; i < 100; i++) ramp.addSample(i, i);
+    CHECK_EQ(ramp.getWarmupSamples(), -1);
+    
+    SteadyStateDetector short_run;
+    for (int i = 0; i < 49; i++) short_run.addSample(settlingSample(i, 10), 10.0);
+    CHECK_EQ(short_run.getWarmupSamples(), -1);
+}
+
+// FCTs 1..n: the interval's order statistics are known exactly
+TEST(p99_half_width_order_statistics) {
+    const int n = 10000;
+    std::vector<double> fcts;
+    for (int i = 1; i <= n; i++) fcts.push_back(i);
+    PhiloxRng rng(4, 0);
+    std::shuffle(fcts.begin(), fcts.end(), rng);
+    
+    // Ranks 9880, 9900 and 9920 (z = 1.96)
+    double expected = (9921.0 - 9881.0) / (2.0 * 9901.0);
+    CHECK(std::abs(SteadyStateDetector::getP99RelativeHalfWidth(fcts) - expected) < 1e-12);
+    
+    std::vector<double> few(100, 1.0);
+    CHECK_EQ(SteadyStateDetector::getP99RelativeHalfWidth(few), std::numeric_limits<double>::infinity());
+}
+
+// Open flows rank above every completed one: the same ranks as long as the
+// interval stays among the completed flows, unbounded once it reaches the open ones
+TEST(p99_half_width_right_censored) {
+    const int n = 10000;
+    std::vector<double> fcts;
+    for (int i = 1; i <= n - 50; i++) fcts.push_back(i);
+    double expected = (9921.0 - 9881.0) / (2.0 * 9901.0);
+    CHECK(std::abs(SteadyStateDetector::getP99RelativeHalfWidth(fcts, 50) - expected) < 1e-12);
+    
+    fcts.resize(n - 90);
+    CHECK_EQ(SteadyStateDetector::getP99RelativeHalfWidth(fcts, 90), std::numeric_limits<double>::infinity());
+}
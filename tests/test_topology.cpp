@@ -0,0 +1,154 @@
+// test_topology.cpp - Formula-mode matchings agree with the generated tables
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include "test.h"
+#include "../topology.h"
+
+// Connections and direct-path times of table and formula modes over two cycles,
+// sampled inside the reconfiguration and across each slot's up window
+static void checkFormulaMatchesTables(int num_racks, int num_switches, TopologyType type) {
+    SimConfig table_cfg;
+    table_cfg.num_racks = num_racks;
+    table_cfg.num_switches = num_switches;
+    table_cfg.topology = type;
+    table_cfg.quiet = true;
+    table_cfg.topology_formula_min_racks = 0;
+    SimConfig formula_cfg = table_cfg;
+    formula_cfg.topology_formula_min_racks = 1;
+    
+    std::unique_ptr<Topology> tables = Topology::create(table_cfg);
+    std::unique_ptr<Topology> formula = Topology::create(formula_cfg);
+    CHECK_EQ(tables->getCycleTime(), formula->getCycleTime());
+    
+    double slot = tables->getSlotTime();
+    const double offsets[] = {0.0, 0.5, 0.9};
+    for (double t0 = 0; t0 < 2 * tables->getCycleTime(); t0 += slot) {
+        for (double offset : offsets) {
+            double t = t0 + offset * slot;
+            for (int src = 0; src < num_racks; src++) {
+                for (int s = 0; s < num_switches; s++) {
+                    CHECK_EQ(tables->getConnectedRack(src, s, t), formula->getConnectedRack(src, s, t));
+                }
+                for (int dst = 0; dst < num_racks; dst++) {
+                    CHECK_EQ(tables->getNextDirectPathTime(src, dst, t), formula->getNextDirectPathTime(src, dst, t));
+                }
+            }
+        }
+    }
+}
+
+TEST(formula_topology_matches_tables_rotor) {
+    checkFormulaMatchesTables(16, 4, TopologyType::ROTOR);
+    checkFormulaMatchesTables(9, 2, TopologyType::ROTOR);
+    checkFormulaMatchesTables(33, 5, TopologyType::ROTOR);
+}
+
+TEST(formula_topology_matches_tables_opera) {
+    checkFormulaMatchesTables(16, 4, TopologyType::OPERA);
+    checkFormulaMatchesTables(12, 3, TopologyType::OPERA);
+}
+
+// getNextDirectPathTime against a walk of the schedule: rotor tries the same
+// in-slot offset one slot at a time, opera every time a circuit comes up; both
+// fall back to a cycle later when no circuit ever connects the racks
+static void checkNextDirectPathMatchesWalk(const SimConfig& cfg) {
+    std::unique_ptr<Topology> topology = Topology::create(cfg);
+    double slot = topology->getSlotTime();
+    double cycle = topology->getCycleTime();
+    int slots_per_cycle = static_cast<int>(std::lround(cycle / slot));
+    // Offsets stay clear of every switch's slot boundary, where either side
+    // may round a time onto the neighbouring slot
+    const double offsets[] = {0.01, 0.3, 0.99};
+    for (int i = 0; i < 2 * slots_per_cycle; i++) {
+        for (double offset : offsets) {
+            double t = (i + offset) * slot;
+            for (int src = 0; src < cfg.num_racks; src++) {
+                for (int dst = 0; dst < cfg.num_racks; dst++) {
+                    if (dst == src) continue;  // No flow targets its own rack
+                    double expected = t + cycle;
+                    if (cfg.topology == TopologyType::ROTOR) {
+                        for (int k = 0; k < slots_per_cycle; k++) {
+                            if (topology->hasDirectPath(src, dst, t + k * slot)) {
+                                expected = t + k * slot;
+                                break;
+                            }
+                        }
+                    } else if (topology->hasDirectPath(src, dst, t)) {
+                        expected = t;
+                    } else {
+                        for (double up = topology->getNextCircuitUpTime(t); up < t + cycle;
+                             up = topology->getNextCircuitUpTime(up)) {
+                            // Just after the circuit comes up, past any rounding of the up time
+                            if (topology->hasDirectPath(src, dst, up + 1e-3)) {
+                                expected = up;
+                                break;
+                            }
+                        }
+                    }
+                    CHECK(std::fabs(topology->getNextDirectPathTime(src, dst, t) - expected) < 1e-6);
+                }
+            }
+        }
+    }
+}
+
+static void checkNextDirectPathMatchesWalk(int num_racks, int num_switches, TopologyType type) {
+    SimConfig cfg;
+    cfg.num_racks = num_racks;
+    cfg.num_switches = num_switches;
+    cfg.topology = type;
+    cfg.quiet = true;
+    cfg.topology_formula_min_racks = 0;
+    checkNextDirectPathMatchesWalk(cfg);
+    cfg.topology_formula_min_racks = 1;
+    checkNextDirectPathMatchesWalk(cfg);
+}
+
+TEST(next_direct_path_matches_walk) {
+    checkNextDirectPathMatchesWalk(16, 4, TopologyType::ROTOR);
+    checkNextDirectPathMatchesWalk(9, 2, TopologyType::ROTOR);
+    checkNextDirectPathMatchesWalk(16, 4, TopologyType::OPERA);
+    checkNextDirectPathMatchesWalk(12, 3, TopologyType::OPERA);
+}
+
+// Loaded schedules may repeat a pairing within a switch's sequence, use it on
+// several switches, or give the switches sequences of different lengths
+TEST(next_direct_path_matches_walk_loaded_schedule) {
+    const char* schedule = "test_repeated_schedule.csv";
+    {
+        std::ofstream file(schedule);
+        file << "0,1,0,3,2\n0,2,3,0,1\n0,1,0,3,2\n0,3,2,1,0\n";
+        file << "1,1,0,3,2\n1,3,2,1,0\n";
+    }
+    SimConfig cfg;
+    cfg.num_racks = 4;
+    cfg.num_switches = 2;
+    cfg.quiet = true;
+    cfg.schedule_file = schedule;
+    checkNextDirectPathMatchesWalk(cfg);
+    cfg.topology = TopologyType::OPERA;
+    checkNextDirectPathMatchesWalk(cfg);
+    std::remove(schedule);
+}
+
+// Slot boundary events fire at getNextCircuitUpTime; however the times round
+// deep into a run, every circuit must already be up there
+static void checkCircuitsUpAtBoundaries(TopologyType type) {
+    SimConfig cfg;
+    cfg.num_racks = 16;
+    cfg.num_switches = 4;
+    cfg.topology = type;
+    cfg.quiet = true;
+    std::unique_ptr<Topology> topology = Topology::create(cfg);
+    for (double up = topology->getNextCircuitUpTime(0); up < 200000; up = topology->getNextCircuitUpTime(up)) {
+        for (int s = 0; s < cfg.num_switches; s++) {
+            CHECK_EQ(topology->getConnectedRack(1, s, up), topology->getConnectedRack(1, s, up + 1));
+        }
+    }
+}
+
+TEST(circuits_up_at_slot_boundaries) {
+    checkCircuitsUpAtBoundaries(TopologyType::ROTOR);
+    checkCircuitsUpAtBoundaries(TopologyType::OPERA);
+}
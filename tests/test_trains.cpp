@@ -0,0 +1,74 @@
+// test_trains.cpp - Packet trains give the same results as per-packet events
+#include <cstdio>
+#include <fstream>
+#include "test_sim.h"
+#include "../simulator.h"
+
+static void checkTrainsMatchPackets(SimConfig cfg) {
+    cfg.sample_interval_ms = 0.5;
+    cfg.packet_train_max_pkts = 1;
+    Statistics packets = runSimulation(cfg);
+    cfg.packet_train_max_pkts = 16;
+    Statistics trains = runSimulation(cfg);
+    CHECK(packets.getCompletedFlows() > 0);
+    checkSameResults(packets, trains);
+}
+
+TEST(trains_match_packets_direct) {
+    SimConfig cfg = quietConfig();
+    cfg.routing = RoutingMode::DIRECT;
+    checkTrainsMatchPackets(cfg);
+}
+
+// Small VOQs: drops depend on train packets holding their slots until they start
+TEST(trains_match_packets_vlb_small_queues) {
+    SimConfig cfg = quietConfig();
+    cfg.routing = RoutingMode::VLB;
+    cfg.load_factor = 0.8;
+    cfg.queue_size_pkts = 50;
+    checkTrainsMatchPackets(cfg);
+}
+
+// Staggered circuits: each switch starts and ends trains at its own reconfigurations
+TEST(trains_match_packets_opera) {
+    SimConfig cfg = quietConfig();
+    cfg.routing = RoutingMode::VLB;
+    cfg.topology = TopologyType::OPERA;
+    checkTrainsMatchPackets(cfg);
+}
+
+// Both switches run the same matchings: two uplinks always share each partner
+TEST(trains_match_packets_parallel_circuits) {
+    const char* schedule = "test_parallel_schedule.csv";
+    {
+        std::ofstream file(schedule);
+        for (int s = 0; s < 2; s++) {
+            file << s << ",1,0,3,2\n" << s << ",2,3,0,1\n" << s << ",3,2,1,0\n";
+        }
+    }
+    SimConfig cfg = quietConfig();
+    cfg.num_racks = 4;
+    cfg.num_switches = 2;
+    cfg.schedule_file = schedule;
+    cfg.routing = RoutingMode::DIRECT;
+    checkTrainsMatchPackets(cfg);
+    std::remove(schedule);
+}
+
+TEST(trains_match_packets_drain) {
+    SimConfig cfg = quietConfig();
+    cfg.routing = RoutingMode::DIRECT;
+    cfg.load_factor = 0.2;
+    cfg.drain_cap_ms = 5;
+    checkTrainsMatchPackets(cfg);
+}
+
+TEST(trains_reject_queue_length_routing) {
+    SimConfig cfg = quietConfig();
+    cfg.packet_train_max_pkts = 16;
+    cfg.routing = RoutingMode::THRESHOLD;
+    CHECK_THROWS(runSimulation(cfg));
+    cfg.routing = RoutingMode::VLB;
+    cfg.model_hosts = true;
+    CHECK_THROWS(runSimulation(cfg));
+}
@@ -1,22 +1,37 @@
-// topology.h - RotorNet topology and matching management
+// topology.h - Rotor switch topologies (RotorNet, Opera) and matching management
 #ifndef TOPOLOGY_H
 #define TOPOLOGY_H
 
 #include <vector>
 #include <random>
 #include <algorithm>
+#include <memory>
+#include <cmath>
+#include <iostream>
 #include "config.h"
+#include "schedule.h"
 
-class RotorTopology {
-private:
+// Circuit schedule of the rotor switches: which rack each rack is connected to on
+// each switch at each time. Both schedules cycle through the same round-robin
+// matchings; they differ in when each switch reconfigures.
+class Topology {
+protected:
     const SimConfig& config;
     int num_matchings;
     double slot_time_us;
     double cycle_time_us;
     
-    // matchings[switch_id][matching_id][rack_id] = connected_rack_id
+    // matchings[switch_id][matching_id][rack_id] = connected_rack_id (empty in formula mode)
     std::vector<std::vector<std::vector<int>>> matchings;
     
+    // Closed-form round-robin instead of tables (topology_formula_min_racks)
+    bool use_formula;
+    
+    // Table mode: the (switch, matching) pairs connecting src to dst are
+    // pair_matchings[pair_offsets[src * num_racks + dst] .. pair_offsets[... + 1])
+    std::vector<int> pair_offsets;
+    std::vector<std::pair<int, int>> pair_matchings;
+    
     // Generate a random perfect matching (permutation)
     std::vector<int> generateRandomMatching(std::mt19937& rng) {
         std::vector<int> matching(config.num_racks);
@@ -27,6 +42,18 @@ private:
         return matching;
     }
     
+    // Load an explicit schedule (schedule_file); the cycle covers the longest sequence
+    void loadMatchings() {
+        matchings = ScheduleLoader::load(config.schedule_file, config.num_switches, config.num_racks);
+        num_matchings = 0;
+        for (const auto& sequence : matchings) {
+            num_matchings = std::max(num_matchings, static_cast<int>(sequence.size()));
+        }
+        slot_time_us = config.getSlotTime();
+        cycle_time_us = num_matchings * slot_time_us;
+        indexPairs();
+    }
+    
     // Generate disjoint matchings using a simple rotation method
     void generateMatchings() {
         num_matchings = config.getNumMatchings();
@@ -51,51 +78,187 @@ private:
                 matching[i] = partner;
             }
             
-            all_matchings.push_back(matching);
+            all_matchings.push_back(std::move(matching));
         }
         
         // Distribute matchings across switches
         for (int s = 0; s < config.num_switches; s++) {
             for (int m = s; m < all_matchings.size(); m += config.num_switches) {
-                matchings[s].push_back(all_matchings[m]);
+                matchings[s].push_back(std::move(all_matchings[m]));
             }
         }
+        indexPairs();
+    }
+    
+    // Build pair_offsets/pair_matchings from the tables (counting sort by pair)
+    void indexPairs() {
+        int n = config.num_racks;
+        pair_offsets.assign(static_cast<size_t>(n) * n + 1, 0);
+        for (const auto& sequence : matchings) {
+            for (const auto& matching : sequence) {
+                for (int src = 0; src < n; src++) {
+                    if (matching[src] != src) pair_offsets[static_cast<size_t>(src) * n + matching[src] + 1]++;
+                }
+            }
+        }
+        for (size_t i = 1; i < pair_offsets.size(); i++) {
+            pair_offsets[i] += pair_offsets[i - 1];
+        }
+        pair_matchings.resize(pair_offsets.back());
+        std::vector<int> filled(pair_offsets.begin(), pair_offsets.end() - 1);
+        for (int s = 0; s < static_cast<int>(matchings.size()); s++) {
+            for (int m = 0; m < static_cast<int>(matchings[s].size()); m++) {
+                for (int src = 0; src < n; src++) {
+                    int dst = matchings[s][m][src];
+                    if (dst != src) pair_matchings[filled[static_cast<size_t>(src) * n + dst]++] = {s, m};
+                }
+            }
+        }
+    }
+    
+    // Calls f(switch_id, matching_idx) for each matching that connects src_rack to
+    // dst_rack. Formula mode inverts getPartner: the pair meets in exactly one
+    // tournament round (none if either is rack 0, which the rotation fixes)
+    template <class F>
+    void forEachMatching(int src_rack, int dst_rack, F&& f) const {
+        if (!use_formula) {
+            size_t pair = static_cast<size_t>(src_rack) * config.num_racks + dst_rack;
+            for (int i = pair_offsets[pair]; i < pair_offsets[pair + 1]; i++) {
+                f(pair_matchings[i].first, pair_matchings[i].second);
+            }
+            return;
+        }
+        int n = config.num_racks;
+        if (src_rack == 0 || dst_rack == 0 || src_rack == dst_rack) return;
+        int round = ((dst_rack % (n - 1)) + src_rack - n) % (n - 1);
+        if (round < 0) round += n - 1;
+        f(round % config.num_switches, round / config.num_switches);
+    }
+
+    // Formula mode: the same round-robin tournament and stride dealing as
+    // generateMatchings, computed on demand. Switch s holds tournament rounds
+    // s, s + num_switches, s + 2 * num_switches, ...
+    void initFormula() {
+        num_matchings = config.getNumMatchings();
+        slot_time_us = config.getSlotTime();
+        cycle_time_us = config.getCycleTime();
+    }
+    
+    // Matchings switch_id cycles through
+    int getSequenceLength(int switch_id) const {
+        if (!use_formula) {
+            return static_cast<int>(matchings[switch_id].size());
+        }
+        int rounds = config.num_racks - 1;
+        return switch_id < rounds ? (rounds - 1 - switch_id) / config.num_switches + 1 : 0;
+    }
+    
+    // Rack src_rack is connected to in matching matching_idx of switch_id
+    int getPartner(int switch_id, int matching_idx, int src_rack) const {
+        if (!use_formula) {
+            return matchings[switch_id][matching_idx][src_rack];
+        }
+        if (src_rack == 0) return 0;
+        int n = config.num_racks;
+        int round = switch_id + matching_idx * config.num_switches;
+        int partner = (n - src_rack + round) % (n - 1);
+        return partner == 0 ? n - 1 : partner;
+    }
+    
+    // Matching switch_id uses at time_us in its own schedule, or -1 while it reconfigures
+    int getMatchingIndex(int switch_id, double time_us) const {
+        double time_in_cycle = fmod(time_us, cycle_time_us);
+        int matching_idx = static_cast<int>(time_in_cycle / slot_time_us) % num_matchings;
+        
+        // Same tolerance as isInUpWindow: a slot boundary event computed as the
+        // end of the reconfiguration must find the circuit up
+        double time_in_slot = fmod(time_in_cycle, slot_time_us);
+        if (time_in_slot < config.reconfig_delay_us - 1e-6) {
+            return -1; // link down during reconfig
+        }
+        if (matching_idx >= getSequenceLength(switch_id)) {
+            return -1;
+        }
+        return matching_idx;
+    }
+
+    // Rounding at a slot boundary can report the old matching while
+    // getCircuitDownTime already refers to the next slot; the circuit only counts
+    // as up once that slot's reconfiguration is over
+    bool isInUpWindow(int switch_id, double time_us) const {
+        return getCircuitDownTime(switch_id, time_us) - slot_time_us + config.reconfig_delay_us <= time_us + 1e-6;
     }
 
 public:
-    RotorTopology(const SimConfig& cfg) : config(cfg) {
-        generateMatchings();
+    Topology(const SimConfig& cfg, const char* schedule_name)
+        : config(cfg),
+          use_formula(cfg.schedule_file.empty() && cfg.topology_formula_min_racks > 0 &&
+                      cfg.num_racks >= cfg.topology_formula_min_racks) {
+        if (!config.schedule_file.empty()) {
+            loadMatchings();
+        } else if (use_formula) {
+            initFormula();
+        } else {
+            generateMatchings();
+        }
         
+        if (config.quiet) return;
         std::cout << "Topology initialized:" << std::endl;
+        std::cout << "  Schedule: " << schedule_name << std::endl;
+        if (!config.schedule_file.empty()) {
+            std::cout << "  Matchings: loaded from " << config.schedule_file << std::endl;
+        } else if (use_formula) {
+            std::cout << "  Matchings: closed-form round-robin (no tables)" << std::endl;
+        }
         std::cout << "  Matchings per switch: " << num_matchings << std::endl;
         std::cout << "  Slot time: " << slot_time_us << " μs" << std::endl;
         std::cout << "  Cycle time: " << cycle_time_us << " μs" << std::endl;
         std::cout << std::endl;
     }
     
-    // Get the rack connected to src_rack on switch_id at time t
-    int getConnectedRack(int src_rack, int switch_id, double time_us) {
-        double time_in_cycle = fmod(time_us, cycle_time_us);
-        int matching_idx = static_cast<int>(time_in_cycle / slot_time_us) % num_matchings;
+    virtual ~Topology() {}
+    
+    // Get the rack connected to src_rack on switch_id at time t (-1 if the switch is reconfiguring)
+    virtual int getConnectedRack(int src_rack, int switch_id, double time_us) const = 0;
+    
+    // Check if direct path exists from src to dst at given time
+    virtual bool hasDirectPath(int src_rack, int dst_rack, double time_us) const = 0;
+    
+    // Find next time when direct path will be available
+    virtual double getNextDirectPathTime(int src_rack, int dst_rack, double current_time_us) const = 0;
+    
+    // Next time strictly after time_us at which some circuit comes up (end of a reconfiguration)
+    virtual double getNextCircuitUpTime(double time_us) const = 0;
+    
+    // Time at which the circuit switch_id holds at time_us tears down (start of its next reconfiguration)
+    virtual double getCircuitDownTime(int switch_id, double time_us) const = 0;
+    
+    double getCycleTime() const { return cycle_time_us; }
+    double getSlotTime() const { return slot_time_us; }
+    
+    static std::unique_ptr<Topology> create(const SimConfig& cfg);
+};
 
-        double time_in_slot = fmod(time_in_cycle, slot_time_us);
-        if (time_in_slot < config.reconfig_delay_us) {
-            return -1; // link down during reconfig
+// RotorNet schedule: every switch reconfigures at the same slot boundary, so all
+// circuits are down together for reconfig_delay_us
+class RotorTopology final : public Topology {
+public:
+    RotorTopology(const SimConfig& cfg) : Topology(cfg, "rotor (synchronized)") {}
+    
+    int getConnectedRack(int src_rack, int switch_id, double time_us) const override {
+        if (switch_id < 0 || switch_id >= config.num_switches) {
+            return -1;
         }
-
-        if (switch_id >= 0 && switch_id < matchings.size() &&
-            matching_idx >= 0 && matching_idx < matchings[switch_id].size()) {
-            return matchings[switch_id][matching_idx][src_rack];
+        int matching_idx = getMatchingIndex(switch_id, time_us);
+        if (matching_idx < 0 || !isInUpWindow(switch_id, time_us)) {
+            return -1;
         }
-
-        return -1;
+        return getPartner(switch_id, matching_idx, src_rack);
     }
-
-
     
     // Check if direct path exists from src to dst at given time
     // We are assuming no reconfig delay
-    bool hasDirectPath(int src_rack, int dst_rack, double time_us) {
+    bool hasDirectPath(int src_rack, int dst_rack, double time_us) const override {
         for (int s = 0; s < config.num_switches; s++) {
             if (getConnectedRack(src_rack, s, time_us) == dst_rack) {
                 return true;
@@ -104,23 +267,121 @@ public:
         return false;
     }
     
-    // Find next time when direct path will be available
-    double getNextDirectPathTime(int src_rack, int dst_rack, double current_time_us) {
-        double check_time = current_time_us;
-        double max_time = current_time_us + cycle_time_us;
-        
-        while (check_time < max_time) {
-            if (hasDirectPath(src_rack, dst_rack, check_time)) {
-                return check_time;
+    // Find next time when direct path will be available: the first of
+    // current_time_us, one slot later, two slots later, ... within a cycle at
+    // which a circuit connects the racks. All switches step through their
+    // matchings together, so k slots on every switch uses matching
+    // (first + k) % num_matchings; only the matchings pairing the racks are tried.
+    double getNextDirectPathTime(int src_rack, int dst_rack, double current_time_us) const override {
+        int first = static_cast<int>(fmod(current_time_us, cycle_time_us) / slot_time_us) % num_matchings;
+        int best_k = num_matchings;
+        forEachMatching(src_rack, dst_rack, [&](int switch_id, int matching_idx) {
+            int k = (matching_idx - first + num_matchings) % num_matchings;
+            if (k < best_k && getConnectedRack(src_rack, switch_id, current_time_us + k * slot_time_us) == dst_rack) {
+                best_k = k;
             }
-            check_time += slot_time_us;
+        });
+        if (best_k == num_matchings) {
+            return current_time_us + cycle_time_us; // Next cycle
         }
-        
-        return current_time_us + cycle_time_us; // Next cycle
+        return current_time_us + best_k * slot_time_us;
     }
     
-    double getCycleTime() const { return cycle_time_us; }
-    double getSlotTime() const { return slot_time_us; }
+    double getNextCircuitUpTime(double time_us) const override {
+        double up = std::floor(time_us / slot_time_us) * slot_time_us + config.reconfig_delay_us;
+        if (up <= time_us) up += slot_time_us;
+        return up;
+    }
+    
+    double getCircuitDownTime(int /*switch_id*/, double time_us) const override {
+        double down = (std::floor(time_us / slot_time_us) + 1) * slot_time_us;
+        if (down <= time_us) down += slot_time_us;
+        return down;
+    }
 };
 
+// Opera schedule: switch s reconfigures s * slot_time / num_switches after switch 0,
+// so only one switch is down at a time and every rack always has
+// num_switches - 1 circuits up
+class OperaTopology final : public Topology {
+private:
+    double offset_step_us;  // Stagger between consecutive switches
+    
+    // Time in switch_id's own (unshifted) schedule
+    double toSwitchTime(int switch_id, double time_us) const {
+        double t = time_us - switch_id * offset_step_us;
+        return t < 0 ? t + cycle_time_us : t;
+    }
+
+public:
+    OperaTopology(const SimConfig& cfg)
+        : Topology(cfg, "opera (staggered)"),
+          offset_step_us(cfg.getSlotTime() / cfg.num_switches) {}
+    
+    int getConnectedRack(int src_rack, int switch_id, double time_us) const override {
+        if (switch_id < 0 || switch_id >= config.num_switches) {
+            return -1;
+        }
+        int matching_idx = getMatchingIndex(switch_id, toSwitchTime(switch_id, time_us));
+        if (matching_idx < 0 || !isInUpWindow(switch_id, time_us)) {
+            return -1;
+        }
+        return getPartner(switch_id, matching_idx, src_rack);
+    }
+    
+    bool hasDirectPath(int src_rack, int dst_rack, double time_us) const override {
+        for (int s = 0; s < config.num_switches; s++) {
+            if (getConnectedRack(src_rack, s, time_us) == dst_rack) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // Earliest time >= current_time_us at which some switch connects src to dst
+    // with its circuit up: for each matching pairing the racks, its next slot in
+    // that switch's schedule (a cycle later if the current one already went down)
+    double getNextDirectPathTime(int src_rack, int dst_rack, double current_time_us) const override {
+        double best = current_time_us + cycle_time_us;
+        forEachMatching(src_rack, dst_rack, [&](int switch_id, int matching_idx) {
+            double t = toSwitchTime(switch_id, current_time_us);
+            double shift = current_time_us - t;
+            double slot_start = std::floor(t / slot_time_us) * slot_time_us;
+            long first_slot = static_cast<long>(std::floor(t / slot_time_us));
+            
+            int k = static_cast<int>(((matching_idx - first_slot) % num_matchings + num_matchings) % num_matchings);
+            double start = slot_start + k * slot_time_us;
+            double up = std::max(t, start + config.reconfig_delay_us);
+            if (up >= start + slot_time_us) {  // This slot's circuit already went down
+                start += cycle_time_us;
+                up = start + config.reconfig_delay_us;
+            }
+            best = std::min(best, up + shift);
+        });
+        return best;
+    }
+    
+    // Circuits come up every offset_step_us (one switch at a time)
+    double getNextCircuitUpTime(double time_us) const override {
+        double up = std::floor((time_us - config.reconfig_delay_us) / offset_step_us) * offset_step_us
+                    + config.reconfig_delay_us;
+        while (up <= time_us) up += offset_step_us;
+        return up;
+    }
+    
+    double getCircuitDownTime(int switch_id, double time_us) const override {
+        double t = toSwitchTime(switch_id, time_us);
+        double down = (std::floor(t / slot_time_us) + 1) * slot_time_us + (time_us - t);
+        if (down <= time_us) down += slot_time_us;
+        return down;
+    }
+};
+
+inline std::unique_ptr<Topology> Topology::create(const SimConfig& cfg) {
+    if (cfg.topology == TopologyType::OPERA) {
+        return std::unique_ptr<Topology>(new OperaTopology(cfg));
+    }
+    return std::unique_ptr<Topology>(new RotorTopology(cfg));
+}
+
 #endif // TOPOLOGY_H
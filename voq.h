@@ -3,8 +3,12 @@
 #define VOQ_H
 
 #include <queue>
+#include <deque>
 #include <map>
 #include <vector>
+#include <algorithm>
+#include <cassert>
+#include "checkpoint.h"
 
 // VOQ system for a single rack
 // Maintains two types of queues:
@@ -24,8 +28,27 @@ private:
     // These are packets on their second hop (intermediate -> final_dst)
     std::map<int, std::queue<uint64_t>> nonlocal_voqs;
     
+    // nonlocal_reserved[final_dst] = buffer granted to sources for VLB packets
+    // still on their first hop (lossless mode credits)
+    std::map<int, size_t> nonlocal_reserved;
+    
+    // A packet train dequeues all its packets when the first one starts, but
+    // each of the others still occupies its queue until it starts serializing
+    // itself. *_train_starts[dst] = start times of those packets, in order
+    std::map<int, std::deque<double>> local_train_starts;
+    std::map<int, std::deque<double>> nonlocal_train_starts;
+    
+    // Hybrid: a fluid entry occupies one queue slot but is charged as the packets
+    // it still stands for. local_fluid_pkts[dst] = those charges beyond the slots
+    std::map<int, size_t> local_fluid_pkts;
+    
     // Track total packets in all queues
     int total_packets;
+    
+    static size_t countHeld(const std::map<int, std::deque<double>>& starts, int dst) {
+        auto it = starts.find(dst);
+        return (it == starts.end()) ? 0 : it->second.size();
+    }
 
 public:
     // Default constructor deleted - must provide parameters
@@ -37,13 +60,9 @@ public:
     VirtualOutputQueues(int rack, int num_racks, int capacity) 
         : rack_id(rack), num_racks(num_racks), 
           queue_capacity(capacity), total_packets(0) {
-        // Initialize VOQs for each destination
-        for (int i = 0; i < num_racks; i++) {
-            if (i != rack_id) {
-                local_voqs[i] = std::queue<uint64_t>();
-                nonlocal_voqs[i] = std::queue<uint64_t>();
-            }
-        }
+        // Per-destination queues are created on first enqueue: a rack only ever
+        // talks to a few of its peers, and num_racks^2 empty queues do not fit
+        // in memory at thousands of racks
     }
 
     /// @brief Enqueues a packet in `type` voq
@@ -90,6 +109,19 @@ public:
         return false;
     }
     
+    /// @brief Reads the head of a `type` voq without removing it
+    /// @return true if the voq is non-empty
+    bool front(int dst_rack, uint64_t& packet_id, VoqType type) const
+    {
+        const auto& voqs = (type == VoqType::LOCAL) ? local_voqs : nonlocal_voqs;
+        auto it = voqs.find(dst_rack);
+        if (it == voqs.end() || it->second.empty()) {
+            return false;
+        }
+        packet_id = it->second.front();
+        return true;
+    }
+    
     // Enqueue a LOCAL packet (originating at this rack, first hop)
     // dst_rack is the final destination or intermediate for this packet
     bool enqueueLocal(uint64_t packet_id, int dst_rack) {
@@ -97,7 +129,7 @@ public:
             return false; // Local traffic, shouldn't be here
         }
         
-        if (local_voqs[dst_rack].size() >= queue_capacity) {
+        if (getLocalQueueSize(dst_rack) >= static_cast<size_t>(queue_capacity)) {
             return false; // Queue full
         }
         
@@ -106,6 +138,27 @@ public:
         return true;
     }
     
+    // Enqueue a hybrid-mode fluid entry charged as `pkts` packets. It stands for a
+    // whole flow, so it is admitted even when that exceeds the capacity
+    void enqueueFluid(uint64_t packet_id, int dst_rack, size_t pkts) {
+        assert(pkts > 0 && "Fluid entry without packets");
+        local_voqs[dst_rack].push(packet_id);
+        local_fluid_pkts[dst_rack] += pkts - 1;
+        total_packets += static_cast<int>(pkts);
+    }
+    
+    // Lowers a queued fluid entry's charge from from_pkts to to_pkts (at least 1,
+    // the slot it keeps until dequeued) as its chunks start
+    void shrinkFluid(int dst_rack, size_t from_pkts, size_t to_pkts) {
+        assert(to_pkts > 0 && to_pkts <= from_pkts && "Fluid charge must shrink to at least one packet");
+        if (to_pkts == from_pkts) return;
+        auto it = local_fluid_pkts.find(dst_rack);
+        assert(it != local_fluid_pkts.end() && it->second >= from_pkts - to_pkts);
+        it->second -= from_pkts - to_pkts;
+        if (it->second == 0) local_fluid_pkts.erase(it);
+        total_packets -= static_cast<int>(from_pkts - to_pkts);
+    }
+    
     // Enqueue a NON-LOCAL packet (arrived here as intermediate, second hop)
     // final_dst is the ultimate destination for this packet
     bool enqueueNonlocal(uint64_t packet_id, int final_dst) {
@@ -113,7 +166,7 @@ public:
             return false; // This is the final destination, shouldn't be here
         }
         
-        if (nonlocal_voqs[final_dst].size() >= queue_capacity) {
+        if (getNonlocalQueueSize(final_dst) >= static_cast<size_t>(queue_capacity)) {
             return false; // Queue full
         }
         
@@ -122,30 +175,89 @@ public:
         return true;
     }
     
+    // Lossless/RotorLB: true if a source may send one more VLB packet through this
+    // rack toward final_dst (queued + reserved stays within capacity)
+    bool hasNonlocalCredit(int final_dst) const {
+        return getNonlocalQueueSize(final_dst) + getNonlocalReserved(final_dst) <
+               static_cast<size_t>(queue_capacity);
+    }
+    
+    // Grant one credit toward final_dst (caller checked hasNonlocalCredit)
+    void reserveNonlocal(int final_dst) {
+        nonlocal_reserved[final_dst]++;
+    }
+    
+    // Return an unused credit
+    void releaseNonlocal(int final_dst) {
+        assert(nonlocal_reserved[final_dst] > 0 && "Releasing a credit that was not granted");
+        nonlocal_reserved[final_dst]--;
+    }
+    
+    size_t getNonlocalReserved(int final_dst) const {
+        auto it = nonlocal_reserved.find(final_dst);
+        return (it == nonlocal_reserved.end()) ? 0 : it->second;
+    }
+    
+    // Enqueue a NON-LOCAL packet that holds a credit; never fails
+    void enqueueReservedNonlocal(uint64_t packet_id, int final_dst) {
+        assert(nonlocal_reserved[final_dst] > 0 && "Nonlocal enqueue without credit");
+        nonlocal_reserved[final_dst]--;
+        nonlocal_voqs[final_dst].push(packet_id);
+        total_packets++;
+    }
+    
     // Dequeue from LOCAL VOQ for given destination
     bool dequeueLocal(int dst_rack, uint64_t& packet_id) {
-        if (local_voqs[dst_rack].empty()) {
+        auto it = local_voqs.find(dst_rack);
+        if (it == local_voqs.end() || it->second.empty()) {
             return false;
         }
         
-        packet_id = local_voqs[dst_rack].front();
-        local_voqs[dst_rack].pop();
+        packet_id = it->second.front();
+        it->second.pop();
         total_packets--;
         return true;
     }
     
     // Dequeue from NON-LOCAL VOQ for given final destination
     bool dequeueNonlocal(int final_dst, uint64_t& packet_id) {
-        if (nonlocal_voqs[final_dst].empty()) {
+        auto it = nonlocal_voqs.find(final_dst);
+        if (it == nonlocal_voqs.end() || it->second.empty()) {
             return false;
         }
         
-        packet_id = nonlocal_voqs[final_dst].front();
-        nonlocal_voqs[final_dst].pop();
+        packet_id = it->second.front();
+        it->second.pop();
         total_packets--;
         return true;
     }
     
+    // Keeps counting a packet a train just dequeued until start_us
+    void holdForTrain(int dst_rack, VoqType type, double start_us) {
+        auto& starts = (type == VoqType::LOCAL) ? local_train_starts : nonlocal_train_starts;
+        starts[dst_rack].push_back(start_us);
+        total_packets++;
+    }
+    
+    // Stops counting the train packets that start before time_us, or at time_us
+    // as well if `inclusive` (their start has been processed)
+    void releaseTrainPackets(double time_us, bool inclusive) {
+        for (auto* starts : {&local_train_starts, &nonlocal_train_starts}) {
+            for (auto it = starts->begin(); it != starts->end();) {
+                std::deque<double>& pending = it->second;
+                while (!pending.empty() && (pending.front() < time_us || (inclusive && pending.front() == time_us))) {
+                    pending.pop_front();
+                    total_packets--;
+                }
+                if (pending.empty()) {
+                    it = starts->erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+    
     // Check if LOCAL VOQ has packets for dst_rack
     bool hasLocalPackets(int dst_rack) const {
         auto it = local_voqs.find(dst_rack);
@@ -160,18 +272,21 @@ public:
         return !it->second.empty();
     }
     
-    // Get size of LOCAL VOQ for dst_rack
+    // Get size of LOCAL VOQ for dst_rack (including train packets yet to start
+    // and the packets fluid entries stand for)
     size_t getLocalQueueSize(int dst_rack) const {
         auto it = local_voqs.find(dst_rack);
         if (it == local_voqs.end()) return 0;
-        return it->second.size();
+        auto fluid = local_fluid_pkts.find(dst_rack);
+        size_t fluid_pkts = (fluid == local_fluid_pkts.end()) ? 0 : fluid->second;
+        return it->second.size() + countHeld(local_train_starts, dst_rack) + fluid_pkts;
     }
     
-    // Get size of NON-LOCAL VOQ for final_dst
+    // Get size of NON-LOCAL VOQ for final_dst (including train packets yet to start)
     size_t getNonlocalQueueSize(int final_dst) const {
         auto it = nonlocal_voqs.find(final_dst);
         if (it == nonlocal_voqs.end()) return 0;
-        return it->second.size();
+        return it->second.size() + countHeld(nonlocal_train_starts, final_dst);
     }
     
     // Get total packets across all VOQs
@@ -179,6 +294,18 @@ public:
         return total_packets;
     }
     
+    // Get the deepest single VOQ (local or nonlocal)
+    size_t getMaxQueueSize() const {
+        size_t max_size = 0;
+        for (const auto& pair : local_voqs) {
+            max_size = std::max(max_size, getLocalQueueSize(pair.first));
+        }
+        for (const auto& pair : nonlocal_voqs) {
+            max_size = std::max(max_size, getNonlocalQueueSize(pair.first));
+        }
+        return max_size;
+    }
+    
     // Get all destination racks that have LOCAL packets waiting
     std::vector<int> getNonemptyLocalDestinations() const {
         std::vector<int> dests;
@@ -201,6 +328,66 @@ public:
         return dests;
     }
     
+    void save(CheckpointWriter& out) const {
+        for (const auto* voqs : {&local_voqs, &nonlocal_voqs}) {
+            out.put<uint64_t>(voqs->size());
+            for (const auto& pair : *voqs) {
+                out.put<int32_t>(pair.first);
+                out.putQueue(pair.second);
+            }
+        }
+        out.put<uint64_t>(nonlocal_reserved.size());
+        for (const auto& pair : nonlocal_reserved) {
+            out.put<int32_t>(pair.first);
+            out.put<uint64_t>(pair.second);
+        }
+        for (const auto* starts : {&local_train_starts, &nonlocal_train_starts}) {
+            out.put<uint64_t>(starts->size());
+            for (const auto& pair : *starts) {
+                out.put<int32_t>(pair.first);
+                out.putDeque(pair.second);
+            }
+        }
+        out.put<uint64_t>(local_fluid_pkts.size());
+        for (const auto& pair : local_fluid_pkts) {
+            out.put<int32_t>(pair.first);
+            out.put<uint64_t>(pair.second);
+        }
+        out.put<int32_t>(total_packets);
+    }
+    
+    void load(CheckpointReader& in) {
+        for (auto* voqs : {&local_voqs, &nonlocal_voqs}) {
+            voqs->clear();
+            uint64_t count = in.get<uint64_t>();
+            for (uint64_t i = 0; i < count; i++) {
+                int dst = in.get<int32_t>();
+                in.getQueue((*voqs)[dst]);
+            }
+        }
+        nonlocal_reserved.clear();
+        uint64_t count = in.get<uint64_t>();
+        for (uint64_t i = 0; i < count; i++) {
+            int dst = in.get<int32_t>();
+            nonlocal_reserved[dst] = in.get<uint64_t>();
+        }
+        for (auto* starts : {&local_train_starts, &nonlocal_train_starts}) {
+            starts->clear();
+            uint64_t num_queues = in.get<uint64_t>();
+            for (uint64_t i = 0; i < num_queues; i++) {
+                int dst = in.get<int32_t>();
+                in.getDeque((*starts)[dst]);
+            }
+        }
+        local_fluid_pkts.clear();
+        count = in.get<uint64_t>();
+        for (uint64_t i = 0; i < count; i++) {
+            int dst = in.get<int32_t>();
+            local_fluid_pkts[dst] = in.get<uint64_t>();
+        }
+        total_packets = in.get<int32_t>();
+    }
+    
     // Clear all queues (for debugging/reset)
     void clear() {
         for (auto& pair : local_voqs) {
@@ -213,6 +400,9 @@ public:
                 pair.second.pop();
             }
         }
+        local_train_starts.clear();
+        nonlocal_train_starts.clear();
+        local_fluid_pkts.clear();
         total_packets = 0;
     }
 };
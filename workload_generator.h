@@ -2,16 +2,20 @@
 #ifndef WORKLOAD_GENERATOR_H
 #define WORKLOAD_GENERATOR_H
 
-#include <random>
 #include <vector>
+#include <queue>
+#include <thread>
+#include <iterator>
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 #include "flow.h"
 #include "config.h"
+#include "load_profile.h"
+#include "rng.h"
 
 class WorkloadGenerator {
 private:
-    std::mt19937 rng;
     const SimConfig& config;
     uint64_t next_flow_id;
     
@@ -21,7 +25,7 @@ private:
         double prob;
     };
     
-    std::vector<CDFPoint> getCDFForWorkload(WorkloadType type) {
+    static std::vector<CDFPoint> getCDFForWorkload(WorkloadType type) {
         switch(type) {
             case WorkloadType::DATAMINING:
                 // From VL2 paper - Datamining workload
@@ -64,10 +68,34 @@ private:
         return {};
     }
     
-    uint64_t sampleFlowSize() {
-        std::vector<CDFPoint> cdf = getCDFForWorkload(config.workload);
-        std::uniform_real_distribution<double> dist(0.0, 1.0);
-        double rand_val = dist(rng);
+    std::vector<CDFPoint> cdf; // getCDFForWorkload(config.workload)
+    
+    // Every source rack is an independent arrival process with its own counter-based
+    // RNG stream (stream id = rack). The superposition of the per-rack Poisson processes
+    // is the network-wide process, and each rack's flows depend only on (seed, rack),
+    // so racks can be generated on any thread in any order with identical output.
+    struct RackSource {
+        int rack;
+        PhiloxRng rng;
+        LoadProfile profile;
+        double next_arrival_ms;
+        
+        RackSource(const SimConfig& cfg, int rack_id)
+            : rack(rack_id), rng(cfg.random_seed, rack_id), profile(cfg), next_arrival_ms(0.0) {}
+    };
+    
+    std::vector<RackSource> sources;
+    double rack_lambda_per_ms;  // per-rack candidate rate at peak load
+    bool sources_started;
+    
+    // Lazy merge of the rack sources by (arrival time, rack)
+    using PendingArrival = std::pair<double, int>;
+    std::priority_queue<PendingArrival, std::vector<PendingArrival>, std::greater<PendingArrival>> pending;
+    
+    std::ofstream flow_log;
+    
+    uint64_t sampleFlowSize(PhiloxRng& rng) {
+        double rand_val = rng.nextDouble();
         
         // Find the appropriate CDF segment
         for (size_t i = 1; i < cdf.size(); i++) {
@@ -85,78 +113,233 @@ private:
         return cdf.back().size;
     }
     
-    double getAverageFlowSize() {
-        // Approximate average based on workload type
-        switch(config.workload) {
-            case WorkloadType::DATAMINING: return 50e6;  // 50 MB
-            case WorkloadType::WEBSEARCH: return 5e6;    // 5 MB
-            case WorkloadType::HADOOP: return 30e6;      // 30 MB
+    // Exact mean of sampleFlowSize(): within a CDF segment the size is s0 * r^U with
+    // U uniform on [0,1) and r = s1 / s0, whose mean is s0 * (r - 1) / ln(r)
+    double getMeanFlowSize() const {
+        double mean = 0.0;
+        for (size_t i = 1; i < cdf.size(); i++) {
+            double mass = cdf[i].prob - cdf[i-1].prob;
+            double ratio = static_cast<double>(cdf[i].size) / cdf[i-1].size;
+            mean += mass * cdf[i-1].size * (ratio - 1.0) / std::log(ratio);
+        }
+        return mean;
+    }
+    
+    // Arrival rate (flows/ms) for a given offered load
+    double getLambdaPerMs(double load) {
+        int total_hosts = config.num_racks * config.hosts_per_rack;
+        double total_capacity = total_hosts * config.link_rate_gbps * 1e9; // bits/s
+        double avg_flow_size_bits = getMeanFlowSize() * 8;
+        
+        // Poisson arrival process
+        double lambda = (load * total_capacity) / avg_flow_size_bits; // flows/s
+        return lambda / 1000.0;
+    }
+    
+    void startSources() {
+        if (sources_started) return;
+        sources_started = true;
+        
+        rack_lambda_per_ms = getLambdaPerMs(LoadProfile(config).getPeakLoad()) / config.num_racks;
+        sources.reserve(config.num_racks);
+        for (int r = 0; r < config.num_racks; r++) {
+            sources.emplace_back(config, r);
+            if (rack_lambda_per_ms > 0.0) {
+                advanceArrival(sources.back());
+            } else {
+                sources.back().next_arrival_ms = config.sim_time_ms;
+            }
         }
-        return 10e6;
+    }
+    
+    // Advance a source to its next accepted arrival. Candidates are drawn at the
+    // peak rate and thinned against the load profile; a constant profile accepts
+    // every candidate without drawing.
+    void advanceArrival(RackSource& src) {
+        if (config.load_profile == LoadProfileType::CONSTANT) {
+            src.next_arrival_ms += src.rng.exponential(rack_lambda_per_ms);
+            return;
+        }
+        
+        double peak_load = src.profile.getPeakLoad();
+        do {
+            src.next_arrival_ms += src.rng.exponential(rack_lambda_per_ms);
+        } while (src.next_arrival_ms < config.sim_time_ms &&
+                 src.rng.nextDouble() * peak_load >= src.profile.getLoad(src.next_arrival_ms));
+    }
+    
+    // Fill in the flow arriving at src.next_arrival_ms (everything but the id)
+    // and advance the source to its next arrival
+    void drawFlow(RackSource& src, Flow& flow) {
+        flow = Flow();
+        flow.start_time = src.next_arrival_ms;
+        flow.completed = false;
+        
+        // Uniform destination among the other racks (inter-rack traffic only)
+        flow.src_rack = src.rack;
+        flow.dst_rack = static_cast<int>(src.rng.uniformInt(config.num_racks - 1));
+        if (flow.dst_rack >= flow.src_rack) flow.dst_rack++;
+        
+        flow.src_host = static_cast<int>(src.rng.uniformInt(config.hosts_per_rack));
+        flow.dst_host = static_cast<int>(src.rng.uniformInt(config.hosts_per_rack));
+        
+        // Sample flow size
+        flow.size_bytes = sampleFlowSize(src.rng);
+        
+        // Classify as bulk or low-latency (e.g. 15 MB threshold per Opera paper).
+        // Low-latency flows are carried by the packet switch (packet_switch_gbps)
+        flow.type = (flow.size_bytes < config.low_latency_threshold_bytes) ? FlowType::LOW_LATENCY
+                                                                            : FlowType::BULK;
+        
+        advanceArrival(src);
     }
 
 public:
     WorkloadGenerator(const SimConfig& cfg) 
-        : config(cfg), next_flow_id(0) {
-        rng.seed(cfg.random_seed);
+        : config(cfg), next_flow_id(0), rack_lambda_per_ms(0.0), sources_started(false) {
+        cdf = getCDFForWorkload(config.workload);
     }
     
-    std::vector<Flow> generateFlows() {
-        std::vector<Flow> flows;
+    // Lazy arrival state (sources, their RNGs and load profiles, the merge heap).
+    // The flow log is not part of it: a restored run logs only the flows it draws.
+    void save(CheckpointWriter& out) const {
+        out.put(next_flow_id);
+        out.put<uint8_t>(sources_started);
+        out.put(rack_lambda_per_ms);
+        out.put<uint64_t>(sources.size());
+        for (const auto& src : sources) {
+            src.rng.save(out);
+            src.profile.save(out);
+            out.put(src.next_arrival_ms);
+        }
+        auto heap = pending;
+        out.put<uint64_t>(heap.size());
+        for (; !heap.empty(); heap.pop()) {
+            out.put(heap.top().first);
+            out.put<int32_t>(heap.top().second);
+        }
+    }
+    
+    void load(CheckpointReader& in) {
+        in.get(next_flow_id);
+        sources_started = in.get<uint8_t>();
+        in.get(rack_lambda_per_ms);
+        uint64_t count = in.get<uint64_t>();
+        sources.clear();
+        sources.reserve(count);
+        for (uint64_t r = 0; r < count; r++) {
+            sources.emplace_back(config, static_cast<int>(r));
+            sources.back().rng.load(in);
+            sources.back().profile.load(in);
+            in.get(sources.back().next_arrival_ms);
+        }
+        pending = decltype(pending)();
+        count = in.get<uint64_t>();
+        for (uint64_t i = 0; i < count; i++) {
+            double time_ms = in.get<double>();
+            pending.push({time_ms, in.get<int32_t>()});
+        }
+    }
+    
+    // Produce the next flow of the arrival process, in start-time order.
+    // Returns false once arrivals pass sim_time_ms. Flows are generated on demand,
+    // so a run never holds more than the flows that have already arrived.
+    bool nextFlow(Flow& flow) {
+        if (!sources_started) {
+            startSources();
+            for (const auto& src : sources) {
+                pending.push({src.next_arrival_ms, src.rack});
+            }
+        }
         
-        // Calculate arrival rate based on load factor
-        int total_hosts = config.num_racks * config.hosts_per_rack;
-        double total_capacity = total_hosts * config.link_rate_gbps * 1e9; // bits/s
-        double avg_flow_size_bits = getAverageFlowSize() * 8;
+        if (pending.empty() || pending.top().first >= config.sim_time_ms) {
+            return false;
+        }
         
-        // Poisson arrival process
-        double lambda = (config.load_factor * total_capacity) / avg_flow_size_bits; // flows/s
-        double lambda_per_ms = lambda / 1000.0;
+        RackSource& src = sources[pending.top().second];
+        pending.pop();
+        drawFlow(src, flow);
+        flow.id = next_flow_id++;
+        pending.push({src.next_arrival_ms, src.rack});
+        
+        if (flow_log.is_open()) {
+            writeFlowRow(flow_log, flow);
+        }
+        return true;
+    }
+    
+    // Generate the whole arrival window at once, racks spread over num_threads
+    // threads (0 = all hardware threads). Per-rack lists are merged by
+    // (start time, rack), which is exactly the order nextFlow() produces, so the
+    // result does not depend on the thread count.
+    std::vector<Flow> generateFlows(int num_threads = 1) {
+        startSources();
+        if (num_threads <= 0) {
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        num_threads = std::min(num_threads, config.num_racks);
         
-        std::exponential_distribution<double> interarrival(lambda_per_ms);
-        std::uniform_int_distribution<int> rack_dist(0, config.num_racks - 1);
-        std::uniform_int_distribution<int> host_dist(0, config.hosts_per_rack - 1);
+        std::vector<std::vector<Flow>> per_rack(config.num_racks);
+        auto generateRacks = [&](int first) {
+            for (int r = first; r < config.num_racks; r += num_threads) {
+                RackSource& src = sources[r];
+                while (src.next_arrival_ms < config.sim_time_ms) {
+                    per_rack[r].emplace_back();
+                    drawFlow(src, per_rack[r].back());
+                }
+            }
+        };
         
-        double current_time = 0.0;
+        std::vector<std::thread> threads;
+        for (int t = 1; t < num_threads; t++) {
+            threads.emplace_back(generateRacks, t);
+        }
+        generateRacks(0);
+        for (auto& th : threads) {
+            th.join();
+        }
         
-        while (current_time < config.sim_time_ms) {
-            Flow flow;
+        size_t total = 0;
+        for (const auto& list : per_rack) total += list.size();
+        
+        std::vector<Flow> flows;
+        flows.reserve(total);
+        for (auto& list : per_rack) {
+            std::move(list.begin(), list.end(), std::back_inserter(flows));
+            std::vector<Flow>().swap(list);
+        }
+        std::stable_sort(flows.begin(), flows.end(),
+                         [](const Flow& a, const Flow& b) { return a.start_time < b.start_time; });
+        for (auto& flow : flows) {
             flow.id = next_flow_id++;
-            flow.start_time = current_time;
-            flow.completed = false;
-            
-            // Random source and destination
-            flow.src_rack = rack_dist(rng);
-            flow.dst_rack = rack_dist(rng);
-            
-            // Ensure inter-rack traffic
-            while (flow.src_rack == flow.dst_rack) {
-                flow.dst_rack = rack_dist(rng);
-            }
-            
-            flow.src_host = host_dist(rng);
-            flow.dst_host = host_dist(rng);
-            
-            // Sample flow size
-            flow.size_bytes = sampleFlowSize();
-            
-            // Classify as bulk or low-latency (15 MB threshold per Opera paper)
-            // flow.type = (flow.size_bytes >= 15e6) ? FlowType::BULK : FlowType::LOW_LATENCY;
-            // all flow types are Bulk. We are only simulating RotorNet. low-latency packets are sent over packet switch
-            // which is not rotornet
-            flow.type = FlowType::BULK;
-            
-            flows.push_back(flow);
-            
-            // Next arrival time
-            current_time += interarrival(rng);
         }
         
-        std::cout << "Generated " << flows.size() << " flows" << std::endl;
+        if (!config.quiet) std::cout << "Generated " << flows.size() << " flows" << std::endl;
         
         return flows;
     }
     
+    // Stream every flow produced by nextFlow() to filename as it is generated
+    void openFlowLog(const std::string& filename) {
+        flow_log.open(filename);
+        if (!flow_log.is_open()) {
+            throw std::runtime_error("Cannot open file for writing: " + filename);
+        }
+        flow_log << "flow_id,src_rack,dst_rack,src_host,dst_host,size_bytes,start_time_ms,flow_type\n";
+    }
+    
+    static void writeFlowRow(std::ostream& out, const Flow& flow) {
+        out << flow.id << ","
+            << flow.src_rack << ","
+            << flow.dst_rack << ","
+            << flow.src_host << ","
+            << flow.dst_host << ","
+            << flow.size_bytes << ","
+            << flow.start_time << ","
+            << (flow.type == FlowType::BULK ? "bulk" : "low_latency")
+            << "\n";
+    }
+    
     void saveFlowsToFile(const std::vector<Flow>& flows, const std::string& filename) {
         std::ofstream file(filename);
         if (!file.is_open()) {
@@ -168,15 +351,7 @@ public:
         
         // Write flows
         for (const auto& flow : flows) {
-            file << flow.id << ","
-                 << flow.src_rack << ","
-                 << flow.dst_rack << ","
-                 << flow.src_host << ","
-                 << flow.dst_host << ","
-                 << flow.size_bytes << ","
-                 << flow.start_time << ","
-                 << (flow.type == FlowType::BULK ? "bulk" : "low_latency")
-                 << "\n";
+            writeFlowRow(file, flow);
         }
         
         file.close();
@@ -221,7 +396,7 @@ public:
         }
         
         file.close();
-        std::cout << "Loaded " << flows.size() << " flows from " << filename << std::endl;
+        if (!config.quiet) std::cout << "Loaded " << flows.size() << " flows from " << filename << std::endl;
         
         return flows;
     }